@@ -25,6 +25,12 @@ SOFTWARE.
 Sets up PWM control for an LED. The constructor sets the pin output mode. The
 PWM output is linearized.
 
+Linearization uses a calibration table of the duty at every 10% of level, with
+integer interpolation in between. The default table is a square law. Any level
+above 0 is then scaled into the range between the minimum visible and maximum
+allowed duty, so a fixture that only starts to glow at a few percent duty still
+dims smoothly from its lowest visible level.
+
 The dim rate is the ammount the dim level of the LED is changed each time the
 function autoDim() is called. Function autoDim() should be called by a timer, so
 that there is a regular update level of the LED, regardless of the dim rate set.
@@ -44,6 +50,25 @@ Setting the level without the auto dimming, is done with function setLevel();
 
 Level is a percentage.
 
+A scene holds the state, level and dimming settings together. setScene() applies
+all of them with a single update of the pin, so recalling a scene is one change
+to the output rather than a separate state and level change. fadeToScene() instead
+dims from where the output is to the scene's level (0 for an off scene) at the
+scene's dim rate, then applies the rest of the scene. Changing the state, level,
+direction or dimming part way through stops the fade where it is.
+
+Usage (time on, duty x time and off to on cycles) is added up each time the duty
+changes, and when it is read, so there is no extra work on each timer tick.
+
+Where there is more than one output, add them to a pwmLEDGroup and call its
+autoDim() from a single timer, rather than having a timer for each output.
+Outputs that are off or not dimming return straight away.
+
+The timer path (autoDim() and setPinPWM()) is kept in IRAM, so its own code does
+not wait on the flash cache when WiFi or OTA code has pushed it out. It is not
+the whole path - setPinPWM() calls the core's analogWrite(), which is in flash,
+so a tick that changes the duty can still take a cache miss there.
+
 */
 
 //#define DEBUG
@@ -60,6 +85,8 @@ pwmLED::pwmLED( int outputPin, bool startState, int startLevel, int dimRate, boo
   _isCyclic = isCyclic;           // Set mode
   _dimUp =  dimUp;                // Set direction
 
+  this->resetCalibration();       // Square law until told otherwise
+
   pinMode(_outputPin, OUTPUT);
 }
 
@@ -75,6 +102,7 @@ bool pwmLED::getState()
 void pwmLED::setState(bool newState)
 {
   _isOverrun = false;
+  this->stopFade();
   
   if( newState != _outputState )          /// Do nothing if no change in state
   {
@@ -105,6 +133,8 @@ int pwmLED::getLevel()
 // Set level
 void pwmLED::setLevel(int newLevel)
 {
+  this->stopFade();
+
   if( newLevel != _outputLevel )              // Do nothing if no change to level
   {
     _outputLevel = newLevel;
@@ -115,35 +145,71 @@ void pwmLED::setLevel(int newLevel)
 
 
 // Update the pin PWM
-void pwmLED::setPinPWM( int newLevel )
+void IRAM_ATTR pwmLED::setPinPWM( int newLevel )
 {
-  int newOutputPWM = (int)(pow( (float)newLevel/(float)_PWM_LED_LEVEL_IN_MAX, 1/0.5 ) * (float)_PWM_MAX);       // Exponetial linearization
+  const int step = _PWM_LED_LEVEL_IN_MAX / (PWM_LED_CAL_POINTS - 1);
+
+  newLevel = constrain( newLevel, 0, _PWM_LED_LEVEL_IN_MAX );
+
+  int newOutputPWM = 0;
+
+  if( newLevel > 0 )
+  {
+    int point = newLevel / step;                              // Interpolate between calibration points
+    int low = _calibration.points[point];
+    int high = point < PWM_LED_CAL_POINTS - 1 ? _calibration.points[point + 1] : low;
+
+    newOutputPWM = low + ( (high - low) * (newLevel % step) ) / step;
 
-//  int newOutputPWM = (int)((float)_PWM_MAX/(1.0 + exp(-14.0*(((float)newLevel/50.0)/100))));                          // S-curve linearization
+    newOutputPWM = _calibration.minPWM + ( newOutputPWM * (_calibration.maxPWM - _calibration.minPWM) ) / _PWM_MAX;   // Into visible range
+  }
 
-//  int newOutputPWM = map(newLevel, 0, _PWM_LED_LEVEL_IN_MAX, 0, _PWM_MAX);
+  this->updateUsage();                                    // Add up time at the old duty
+  if( _outputPWM == 0 && newOutputPWM > 0 ) _usage.switchCycles++;
+  _outputPWM = newOutputPWM;
 
   analogWrite( _outputPin, newOutputPWM );   // Set output
 
-  DEBUG_PRINT("Pin ");
+  DEBUG_PRINT(F("Pin "));
   DEBUG_PRINT( _outputPin );
-  DEBUG_PRINT(" : Direction: ");
+  DEBUG_PRINT(F(" : Direction: "));
   DEBUG_PRINT( _dimUp );
-  DEBUG_PRINT(", Overrun: ");
+  DEBUG_PRINT(F(", Overrun: "));
   DEBUG_PRINT( _isOverrun );
-  DEBUG_PRINT(", State: ");
+  DEBUG_PRINT(F(", State: "));
   DEBUG_PRINT( _outputState );
-  DEBUG_PRINT(", Level: ");
+  DEBUG_PRINT(F(", Level: "));
   DEBUG_PRINT( newLevel );
-  DEBUG_PRINT(", PWM: ");
+  DEBUG_PRINT(F(", PWM: "));
   DEBUG_PRINTLN( newOutputPWM );
 }
 
 
 // Step to next auto dim level - typically called by a timer
-void pwmLED::autoDim()
+void IRAM_ATTR pwmLED::autoDim()
 {
   if( !_outputState || !_dimLED || _isOverrun ) return;
+
+  if( _isFading )                                 // Stop on the scene's level, then take on the rest of it
+  {
+    int to = _fadeScene.state ? _fadeScene.level : 0;
+
+    if( _dimUp ) _outputLevel = _outputLevel + _dimRate < to ? _outputLevel + _dimRate : to;
+    else _outputLevel = _outputLevel - _dimRate > to ? _outputLevel - _dimRate : to;
+
+    if( _outputLevel == to )
+    {
+      _isFading = false;
+      _outputState = _fadeScene.state;
+      _outputLevel = _fadeScene.level;
+      _dimUp = _fadeScene.dimUp;
+      _dimLED = _fadeScene.dimLED;
+      _isCyclic = _fadeScene.isCyclic;
+    }
+
+    this->setPinPWM( _outputState ? _outputLevel : 0 );
+    return;
+  }
  
   // Go up or down
   
@@ -176,10 +242,18 @@ void pwmLED::autoDim()
 void pwmLED::toggleDimDirection()
 {
   _isOverrun = false;
+  this->stopFade();
   _dimUp = !_dimUp;
 }
 
 
+// Get dim rate
+int pwmLED::getDimRate()
+{
+  return _dimRate;
+}
+
+
 // Set dim rate
 void pwmLED::setDimRate(int dimRate)
 {
@@ -190,6 +264,8 @@ void pwmLED::setDimRate(int dimRate)
 // Set dim direction
 void pwmLED::setDimDirection(bool dimUp)
 {
+  _isOverrun = false;
+  this->stopFade();
   _dimUp = dimUp;
 }
 
@@ -197,6 +273,163 @@ void pwmLED::setDimDirection(bool dimUp)
 // Dim the LED
 void pwmLED::dimLED(bool startDimming)
 {
+  _isFading = false;
   _dimLED = startDimming;
 }
 
+
+// Stop a fade where it is
+void pwmLED::stopFade()
+{
+  if( !_isFading ) return;
+
+  _isFading = false;
+  _dimLED = false;
+}
+
+
+// Get the current scene
+pwmLEDScene pwmLED::getScene()
+{
+  pwmLEDScene scene;
+
+  scene.state = _outputState;
+  scene.level = _outputLevel;
+  scene.dimRate = _dimRate;
+  scene.dimUp = _dimUp;
+  scene.dimLED = _dimLED;
+  scene.isCyclic = _isCyclic;
+
+  return scene;
+}
+
+
+// Set everything from a scene in one go
+void pwmLED::setScene(const pwmLEDScene &scene)
+{
+  _isOverrun = false;
+  _isFading = false;
+  _outputState = scene.state;
+  _outputLevel = constrain( scene.level, 0, _PWM_LED_LEVEL_IN_MAX );
+  _dimRate = scene.dimRate;
+  _dimUp = scene.dimUp;
+  _dimLED = scene.dimLED;
+  _isCyclic = scene.isCyclic;
+
+  this->setPinPWM( _outputState ? _outputLevel : 0 );     // One change to the output
+}
+
+
+// Fade to a scene's level at its dim rate, then set the rest of it
+void pwmLED::fadeToScene(const pwmLEDScene &scene)
+{
+  int from = _outputState ? _outputLevel : 0;
+  int to = scene.state ? constrain( scene.level, 0, _PWM_LED_LEVEL_IN_MAX ) : 0;
+
+  if( from == to || scene.dimRate < 1 )           // Nothing to fade
+  {
+    this->setScene( scene );
+    return;
+  }
+
+  _fadeScene = scene;
+  _fadeScene.level = constrain( scene.level, 0, _PWM_LED_LEVEL_IN_MAX );
+
+  _outputState = true;                            // On while fading, from off starts at 0
+  _outputLevel = from;
+  _dimRate = scene.dimRate;
+  _dimUp = to > from;
+  _dimLED = true;
+  _isOverrun = false;
+  _isFading = true;
+}
+
+
+// Add an output to the group
+bool pwmLEDGroup::add( pwmLED *led )
+{
+  if( _ledCount >= _PWM_LED_GROUP_MAX ) return false;
+
+  _leds[_ledCount++] = led;
+
+  return true;
+}
+
+
+// Step every output in the group to its next auto dim level - typically called by a timer
+void IRAM_ATTR pwmLEDGroup::autoDim()
+{
+  for( int i = 0; i < _ledCount; i++ ) _leds[i]->autoDim();
+}
+
+
+// Get the current calibration
+pwmLEDCalibration pwmLED::getCalibration()
+{
+  return _calibration;
+}
+
+
+// Set calibration
+bool pwmLED::setCalibration(const pwmLEDCalibration &calibration)
+{
+  if( calibration.minPWM < 0 || calibration.maxPWM > _PWM_MAX || calibration.minPWM >= calibration.maxPWM ) return false;
+
+  for( int i = 0; i < PWM_LED_CAL_POINTS; i++ )                   // Must be in range and never go down
+  {
+    if( calibration.points[i] < 0 || calibration.points[i] > _PWM_MAX ) return false;
+    if( i > 0 && calibration.points[i] < calibration.points[i - 1] ) return false;
+  }
+
+  _calibration = calibration;
+
+  if( _outputState ) this->setPinPWM( _outputLevel );             // Show the change
+
+  return true;
+}
+
+
+// Set default calibration
+void pwmLED::resetCalibration()
+{
+  for( int i = 0; i < PWM_LED_CAL_POINTS; i++ )                   // Square law
+  {
+    _calibration.points[i] = ( i * i * _PWM_MAX ) / ( (PWM_LED_CAL_POINTS - 1) * (PWM_LED_CAL_POINTS - 1) );
+  }
+
+  _calibration.minPWM = 0;
+  _calibration.maxPWM = _PWM_MAX;
+}
+
+
+// Add the time at the current duty to the usage
+void IRAM_ATTR pwmLED::updateUsage()
+{
+  unsigned long now = millis();
+  unsigned long elapsed = now - _usageTime;
+
+  _usageTime = now;
+
+  if( _outputPWM == 0 ) return;
+
+  _usage.onMillis += elapsed;
+  _usage.dutyMillis += (unsigned long long)_outputPWM * elapsed;
+}
+
+
+// Get usage up to now
+pwmLEDUsage pwmLED::getUsage()
+{
+  this->updateUsage();
+
+  return _usage;
+}
+
+
+// Set usage
+void pwmLED::setUsage(const pwmLEDUsage &usage)
+{
+  this->updateUsage();
+
+  _usage = usage;
+}
@@ -12,6 +12,38 @@
 #include <math.h>
 
 
+// Output duty for every 10% of level, with the duty range the output is held within
+
+const static int PWM_LED_CAL_POINTS = 11;
+
+struct pwmLEDCalibration {
+  int points[PWM_LED_CAL_POINTS];     // Duty (0 to 1023) at level 0, 10, 20 ... 100
+  int minPWM;                         // Lowest duty that is visible - used for any level above 0
+  int maxPWM;                         // Highest duty allowed
+};
+
+
+// How much an output has been used
+
+struct pwmLEDUsage {
+  unsigned long long onMillis;        // Time on (ms)
+  unsigned long long dutyMillis;      // Duty (0 to 1023) x time (ms)
+  unsigned long switchCycles;         // Times gone from off to on
+};
+
+
+// Everything needed to put an output back the way it was
+
+struct pwmLEDScene {
+  bool state;
+  int level;
+  int dimRate;
+  bool dimUp;
+  bool dimLED;
+  bool isCyclic;
+};
+
+
 class pwmLED {
 
 public:
@@ -37,6 +69,9 @@ public:
   // Step to next auto dim level
   void autoDim();
 
+  // Get dim rate
+  int getDimRate();
+
   // Set dim rate
   void setDimRate(int dimRate);
 
@@ -48,6 +83,30 @@ public:
   
   // Set dim mode
   void dimLED(bool startDimming);
+
+  // Get the current scene
+  pwmLEDScene getScene();
+
+  // Set everything from a scene in one go
+  void setScene(const pwmLEDScene &scene);
+
+  // Fade to a scene's level at its dim rate, then set the rest of it
+  void fadeToScene(const pwmLEDScene &scene);
+
+  // Get the current calibration
+  pwmLEDCalibration getCalibration();
+
+  // Set calibration - returns false and leaves it unchanged if not valid
+  bool setCalibration(const pwmLEDCalibration &calibration);
+
+  // Set default calibration
+  void resetCalibration();
+
+  // Get usage up to now
+  pwmLEDUsage getUsage();
+
+  // Set usage - e.g. carry on from a saved total
+  void setUsage(const pwmLEDUsage &usage);
   
 private:
 
@@ -71,8 +130,47 @@ private:
   bool _isCyclic = false;
   bool _isOverrun = false;
 
+  // Scene being faded to
+  bool _isFading = false;
+  pwmLEDScene _fadeScene;
+
+  // Correction from level to duty
+  pwmLEDCalibration _calibration;
+
+  // Duty last written to the pin, and what it has added up to
+  int _outputPWM = 0;
+  unsigned long _usageTime = 0;
+  pwmLEDUsage _usage = { 0, 0, 0 };
+
   // Update the pin PWM
   void setPinPWM( int newLevel );
+
+  // Add the time at the current duty to the usage
+  void updateUsage();
+
+  // Stop a fade where it is
+  void stopFade();
+};
+
+
+class pwmLEDGroup {
+
+public:
+
+  // Add an output to the group - returns false if the group is full
+  bool add( pwmLED *led );
+
+  // Step every output in the group to its next auto dim level
+  void autoDim();
+
+private:
+
+  // Constants
+  constexpr const static int _PWM_LED_GROUP_MAX = 16;              // Most outputs in a group
+
+  // The outputs in the group
+  pwmLED *_leds[_PWM_LED_GROUP_MAX];
+  int _ledCount = 0;
 };
 
 
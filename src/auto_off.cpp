@@ -0,0 +1,105 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Chris Gregg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+-------------------------------------------------------------------------------------
+
+Fades an output off after a number of minutes without activity.
+
+Call tick() once a minute, typically from a timer - it only counts, so it is safe
+in timer context. Call process() from the main loop, where the fade is started.
+Call restart() on any activity, before acting on it. It starts the count again
+and, if the auto off fade has already started, stops it and puts the dim
+direction back, so the output stays on wherever it had got to.
+
+*/
+
+#include "auto_off.h"
+
+
+// Constructor
+autoOffControl::autoOffControl( pwmLED &led ) :
+  _led( led )
+{
+}
+
+
+// Set minutes of inactivity before fading off
+void autoOffControl::setMinutes( int minutes )
+{
+  _minutes = minutes > 0 ? minutes : 0;
+}
+
+
+// Get minutes of inactivity before fading off
+int autoOffControl::getMinutes()
+{
+  return _minutes;
+}
+
+
+// Activity - start the count again and stop an auto off fade
+void autoOffControl::restart()
+{
+  _remaining = _minutes;
+  _due = false;
+
+  if( _fading )                                   // Stop where it got to
+  {
+    _fading = false;
+    _led.dimLED(false);
+    _led.setDimDirection(_dimUpBefore);
+  }
+}
+
+
+// A minute has gone
+void autoOffControl::tick()
+{
+  if( _remaining > 0 && --_remaining == 0 ) _due = true;
+}
+
+
+// Start the fade when due
+void autoOffControl::process()
+{
+  if( _fading && !_led.getState() ) _fading = false;       // Faded all the way off
+
+  if( !_due ) return;
+  _due = false;
+
+  if( !_led.getState() ) return;
+
+  DEBUG_PRINTLN( F("Auto off") );
+
+  _dimUpBefore = _led.getScene().dimUp;
+  _fading = true;
+
+  _led.setDimDirection(false);
+  _led.dimLED(true);                              // autoDim() turns it off when it reaches 0
+}
+
+
+// Is the auto off fade running
+bool autoOffControl::isFading()
+{
+  return _fading;
+}
@@ -0,0 +1,52 @@
+#ifndef AUTO_OFF_H
+#define AUTO_OFF_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "PWM_LED_control.h"
+
+
+class autoOffControl {
+
+public:
+
+  // Constructor
+  autoOffControl( pwmLED &led );
+
+  // Set minutes of inactivity before fading off (0 = never)
+  void setMinutes( int minutes );
+
+  // Get minutes of inactivity before fading off
+  int getMinutes();
+
+  // Activity - start the count again and stop an auto off fade. Call before acting on the activity
+  void restart();
+
+  // A minute has gone - typically called by a timer
+  void tick();
+
+  // Start the fade when due - call from the main loop
+  void process();
+
+  // Is the auto off fade running
+  bool isFading();
+
+private:
+
+  // The output to fade
+  pwmLED &_led;
+
+  int _minutes = 0;
+  volatile int _remaining = 0;        // Minutes left before auto off (0 = not counting)
+  volatile bool _due = false;         // Set by tick(), acted on by process()
+
+  bool _fading = false;               // Auto off fade running
+  bool _dimUpBefore = true;           // Dim direction before the fade, put back if stopped
+};
+
+
+#endif
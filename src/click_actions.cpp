@@ -0,0 +1,141 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Chris Gregg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+-------------------------------------------------------------------------------------
+
+What the button does to the output:
+
+  - Double click toggles on or off (full on if the level was 0)
+  - Press and hold dims, changing direction each time it is let go
+  - Holding when off turns on at 0 and dims up, once the press is held for the
+    double click period (a single click)
+
+Hold to dim starts at the output's own rate, so short holds give fine adjustment,
+then speeds up to the fast and very fast rates after the times set with
+setAcceleration(). The output's rate is put back when the button is let go.
+
+With setSpeculative(true), a press when off turns on and dims up straight away,
+without waiting for the single click. How the output was is kept, and put back if
+the button is let go before it counts as a single click - including the first
+half of a double click.
+
+*/
+
+#include "click_actions.h"
+
+
+// Constructor
+clickActions::clickActions( Switch &button, pwmLED &led, int normalRate, int fastRate, int veryFastRate ) :
+  _button( button ), _led( led )
+{
+  _holdBaseRate = normalRate;
+  _fastRate = fastRate;
+  _veryFastRate = veryFastRate;
+}
+
+
+// Act on the button
+void clickActions::process()
+{
+  if( _speculative )
+  {
+    if( _button.pushed() && !_button.doubleClick() && !_led.getState() )   // Could be a single click - start now
+    {
+      _clickUndo = _led.getScene();
+      _clickSpeculated = true;
+      this->startClickDim();
+    }
+    else if( _button.released() && _clickSpeculated )                 // Let go too soon, or first of a double click - put it back
+    {
+      _led.setScene( _clickUndo );
+      _clickSpeculated = false;
+    }
+  }
+
+  if( _button.pushed() ) _holdBaseRate = _led.getDimRate();           // Put back after the hold
+
+  if( _button.doubleClick() )                       // Toggle on/offf
+  {
+    if( _led.getLevel() == 0 )                      // If off then set dim to full on
+    {
+      _led.setLevel(100);
+      _led.setDimDirection(true);
+    }
+    _led.toggleState();                                                 // If double click then toggle state
+  }
+  else if( _button.released() )                                         // Stop dimming and change direction on release
+  {
+    _led.dimLED(false);
+    _led.setDimRate(_holdBaseRate);
+    _led.toggleDimDirection();
+  }
+  else if( _led.getState() && _button.on() )                            // Dim if on and pushed
+  {
+    _led.setDimRate( this->holdDimRate() );
+    _led.dimLED(true);
+  }
+  else if( _button.singleClick() && !_clickSpeculated ) this->startClickDim();   // Click to dim
+
+  if( _button.singleClick() ) _clickSpeculated = false;                 // No double click came
+}
+
+
+// Set speculative single click
+void clickActions::setSpeculative( bool speculative )
+{
+  _speculative = speculative;
+}
+
+
+// Get hold to dim speed up
+dimAccel clickActions::getAcceleration()
+{
+  return _accel;
+}
+
+
+// Set hold to dim speed up
+void clickActions::setAcceleration( const dimAccel &accel )
+{
+  _accel = accel;
+}
+
+
+// Single click action - turn on at 0 ready to dim up
+void clickActions::startClickDim()
+{
+  _led.setLevel(0);
+  _led.setDimDirection(true);
+  _led.setState(true);
+}
+
+
+// Dim rate for how long the button has been held - short holds stay at the output's rate for fine adjustment
+int clickActions::holdDimRate()
+{
+  unsigned long held = _button.onTime();
+
+  if( _accel.veryFastAfter > 0 && held >= (unsigned long)_accel.veryFastAfter ) return _holdBaseRate > _veryFastRate ? _holdBaseRate : _veryFastRate;
+  if( _accel.fastAfter > 0 && held >= (unsigned long)_accel.fastAfter ) return _holdBaseRate > _fastRate ? _holdBaseRate : _fastRate;
+
+  return _holdBaseRate;
+}
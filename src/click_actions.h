@@ -0,0 +1,66 @@
+#ifndef CLICK_ACTIONS_H
+#define CLICK_ACTIONS_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include "switch_v2.h"
+#include "PWM_LED_control.h"
+
+
+// How hold to dim speeds up
+
+struct dimAccel {
+  int fastAfter;                      // Hold time (ms) before dimming at the fast rate (0 = never)
+  int veryFastAfter;                  // Hold time (ms) before dimming at the very fast rate (0 = never)
+};
+
+
+class clickActions {
+
+public:
+
+  // Constructor
+  clickActions( Switch &button, pwmLED &led, int normalRate, int fastRate, int veryFastRate );
+
+  // Act on the button - call after each poll()
+  void process();
+
+  // Set speculative single click
+  void setSpeculative( bool speculative );
+
+  // Get hold to dim speed up
+  dimAccel getAcceleration();
+
+  // Set hold to dim speed up
+  void setAcceleration( const dimAccel &accel );
+
+private:
+
+  // The button and the output it controls
+  Switch &_button;
+  pwmLED &_led;
+
+  // Dim rates and when to use them
+  int _fastRate;
+  int _veryFastRate;
+  dimAccel _accel = { 0, 0 };
+  int _holdBaseRate;                  // Dim rate before the hold
+
+  // Speculative single click
+  bool _speculative = false;
+  bool _clickSpeculated = false;      // Acted on a press before knowing it was a single click
+  pwmLEDScene _clickUndo;             // How the output was before
+
+  // Single click action - turn on at 0 ready to dim up
+  void startClickDim();
+
+  // Dim rate for how long the button has been held
+  int holdDimRate();
+};
+
+
+#endif
@@ -0,0 +1,212 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Chris Gregg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+-------------------------------------------------------------------------------------
+
+Leaves breadcrumbs in RTC memory so that after a hang and reset, it is possible
+to see where it was.
+
+Call stage() on entering each part of setup() and loop(). It only notes the stage
+ID and cycle count in RAM, and adds the time of the stage it left to a histogram,
+without a division, so it is cheap enough for every pass of loop(). The last 4
+stages are kept.
+
+Call check() from a timer as a software watchdog. Each time, it writes the
+breadcrumbs into RTC memory, which survives a watchdog reset. If the same stage
+has been running for longer than its budget it is noted in RTC memory, the
+restart callback (if set) is called, and the ESP restarted.
+A timer only runs when the stage yields, so a stage that never yields is left to
+the hardware watchdog - the breadcrumbs then show where it was at the last check,
+so the stage that hung is the current one there, or entered just after.
+
+After begin(), the breadcrumbs and reset reason of the last run can be read.
+
+Time in each stage is also kept as a max and a histogram. Times come from the
+cycle count, so are only right for stages shorter than about 53s (at 80MHz).
+The max times are written to RTC memory with the breadcrumbs, so the last run's
+can be read after a reset - a stage the software watchdog restarted in has the
+time it had been running.
+
+*/
+
+#include "hang_detect.h"
+
+
+// Constructor
+hangDetector::hangDetector( const unsigned long *budgets, int stageCount )
+{
+  _budgets = budgets;
+  _stageCount = constrain( stageCount, 0, MAX_STAGES );
+
+  memset( _histogram, 0, sizeof(_histogram) );
+  memset( _maxCycles, 0, sizeof(_maxCycles) );
+  memset( &_rtc, 0, sizeof(_rtc) );
+}
+
+
+// Read the last run from RTC memory and start this one
+void hangDetector::begin()
+{
+  ESP.rtcUserMemoryRead( _RTC_OFFSET, (uint32_t *)&_rtc, sizeof(_rtc) );
+
+  if( _rtc.magic == _RTC_MAGIC )
+  {
+    _lastHistory = _rtc.history;
+    _lastTripped = _rtc.tripped;
+    memcpy( _lastMaxTime, _rtc.maxTime, sizeof(_lastMaxTime) );
+  }
+  else                                                    // Power on, or not ours
+  {
+    _lastHistory = 0xFFFFFFFF;
+    _lastTripped = NO_STAGE;
+    memset( _lastMaxTime, 0, sizeof(_lastMaxTime) );
+  }
+
+  _resetReason = ESP.getResetInfoPtr()->reason;
+
+  uint32_t cyclesPerMs = ESP.getCpuFreqMHz() * 1000UL;
+
+  for( int i = 0; i < HISTOGRAM_BUCKETS - 1; i++ ) _bucketCycles[i] = cyclesPerMs << i;   // <1ms, <2ms, <4ms ...
+
+  _stageCycles = ESP.getCycleCount();
+
+  _rtc.magic = _RTC_MAGIC;
+  _rtc.tripped = NO_STAGE;
+  this->writeRTC();
+}
+
+
+// Entering a stage
+void hangDetector::stage( uint8_t id )
+{
+  uint32_t now = ESP.getCycleCount();
+
+  if( _stage < _stageCount )                              // Time the stage just left
+  {
+    uint32_t cycles = now - _stageCycles;
+    int bucket = 0;
+
+    while( bucket < HISTOGRAM_BUCKETS - 1 && cycles >= _bucketCycles[bucket] ) bucket++;
+
+    _histogram[_stage][bucket]++;
+    if( cycles > _maxCycles[_stage] ) _maxCycles[_stage] = cycles;
+  }
+
+  _stage = id;
+  _stageSequence++;
+
+  _history = ( _history << 8 ) | id;
+  _stageCycles = now;
+}
+
+
+// Software watchdog
+void hangDetector::check( unsigned long sinceLastCheck )
+{
+  this->writeRTC();
+
+  if( _stage >= _stageCount ) return;
+
+  if( _stageSequence != _checkedSequence )                // Moved on since last time
+  {
+    _checkedSequence = _stageSequence;
+    _stageElapsed = 0;
+    return;
+  }
+
+  _stageElapsed += sinceLastCheck;
+
+  if( _budgets[_stage] == 0 || _stageElapsed <= _budgets[_stage] ) return;
+
+  _rtc.tripped = _stage;
+  if( _stageElapsed > _rtc.maxTime[_stage] ) _rtc.maxTime[_stage] = _stageElapsed;
+  ESP.rtcUserMemoryWrite( _RTC_OFFSET, (uint32_t *)&_rtc, sizeof(_rtc) );
+
+  if( _restartCallback ) _restartCallback();          // After the breadcrumbs, in case it hangs too
+
+  ESP.restart();
+}
+
+
+// Copy the breadcrumbs and max times into the RTC record and write it
+void hangDetector::writeRTC()
+{
+  uint32_t cyclesPerMs = _bucketCycles[0];
+
+  _rtc.history = _history;
+  _rtc.stageCycles = _stageCycles;
+
+  for( int i = 0; i < _stageCount; i++ ) _rtc.maxTime[i] = _maxCycles[i] / cyclesPerMs;
+
+  ESP.rtcUserMemoryWrite( _RTC_OFFSET, (uint32_t *)&_rtc, sizeof(_rtc) );
+}
+
+
+// Called by check() just before it restarts
+void hangDetector::setRestartCallback( void (*func)() )
+{
+  _restartCallback = func;
+}
+
+
+// Last run - stages entered
+uint8_t hangDetector::getLastStage( int back )
+{
+  if( back < 0 || back > 3 ) return NO_STAGE;
+
+  return ( _lastHistory >> ( 8 * back ) ) & 0xFF;
+}
+
+
+// Last run - stage the software watchdog restarted in
+uint8_t hangDetector::getTrippedStage()
+{
+  return _lastTripped;
+}
+
+
+// Reason for the last reset
+uint32_t hangDetector::getResetReason()
+{
+  return _resetReason;
+}
+
+
+// Last run - longest time spent in a stage
+unsigned long hangDetector::getLastMaxTime( uint8_t id )
+{
+  return id < _stageCount ? _lastMaxTime[id] : 0;
+}
+
+
+// Longest time spent in a stage
+unsigned long hangDetector::getMaxTime( uint8_t id )
+{
+  return id < _stageCount ? _maxCycles[id] / _bucketCycles[0] : 0;
+}
+
+
+// Histogram of time spent in a stage
+const unsigned long *hangDetector::getHistogram( uint8_t id )
+{
+  return id < _stageCount ? _histogram[id] : NULL;
+}
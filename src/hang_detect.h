@@ -0,0 +1,94 @@
+#ifndef HANG_DETECT_H
+#define HANG_DETECT_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+
+class hangDetector {
+
+public:
+
+  // Constants
+  constexpr const static int MAX_STAGES = 16;                       // Most stages that can be tracked
+  constexpr const static int HISTOGRAM_BUCKETS = 8;                 // <1ms, 1ms, 2-3ms, 4-7ms ... 64ms and over
+  constexpr const static uint8_t NO_STAGE = 0xFF;                   // No stage recorded
+
+  // Constructor - budgets are the most time (ms) allowed in each stage, 0 for no limit
+  hangDetector( const unsigned long *budgets, int stageCount );
+
+  // Read the last run from RTC memory and start this one - call first thing in setup()
+  void begin();
+
+  // Entering a stage - kept in RAM only, so it is cheap enough for every pass of loop()
+  void stage( uint8_t id );
+
+  // Software watchdog - typically called by a timer. Writes the breadcrumbs to RTC memory, and restarts
+  // if the current stage is over budget
+  void check( unsigned long sinceLastCheck );
+
+  // Called by check() just before it restarts, e.g. to save state
+  void setRestartCallback( void (*func)() );
+
+  // Last run - stages entered, newest first, NO_STAGE if not known
+  uint8_t getLastStage( int back = 0 );
+
+  // Last run - stage the software watchdog restarted in, NO_STAGE if it didn't
+  uint8_t getTrippedStage();
+
+  // Reason for the last reset (rst_info reason)
+  uint32_t getResetReason();
+
+  // Last run - longest time spent in a stage (ms)
+  unsigned long getLastMaxTime( uint8_t id );
+
+  // Longest time spent in a stage this run (ms)
+  unsigned long getMaxTime( uint8_t id );
+
+  // Count of times in a stage falling in each histogram bucket this run
+  const unsigned long *getHistogram( uint8_t id );
+
+private:
+
+  // Constants
+  constexpr const static uint32_t _RTC_MAGIC = 0x48414E47;           // Marks RTC memory as ours
+  constexpr const static uint32_t _RTC_OFFSET = 64;                  // RTC user memory block, clear of the OTA boot command
+
+  // Kept in RTC memory over a reset
+  struct {
+    uint32_t magic;
+    uint32_t history;               // Last 4 stages, newest in low byte
+    uint32_t stageCycles;           // Cycle count when newest stage started
+    uint32_t tripped;               // Stage watchdog restarted in
+    uint32_t maxTime[MAX_STAGES];   // Longest time in each stage (ms)
+  } _rtc;
+
+  // From the last run
+  uint32_t _lastHistory;
+  uint32_t _lastTripped;
+  uint32_t _resetReason;
+  uint32_t _lastMaxTime[MAX_STAGES];
+
+  // This run
+  const unsigned long *_budgets;
+  int _stageCount;
+  uint8_t _stage = NO_STAGE;
+  uint32_t _history = 0xFFFFFFFF;             // Last 4 stages, newest in low byte
+  uint32_t _stageCycles = 0;                  // Cycle count when the current stage started
+  uint32_t _maxCycles[MAX_STAGES];            // Longest time in each stage (cycles)
+  uint32_t _bucketCycles[HISTOGRAM_BUCKETS - 1];  // Cycles at the top of each histogram bucket
+  unsigned long _stageSequence = 0;           // Changes each stage, so check() can tell it moved on
+  unsigned long _checkedSequence = 0;
+  unsigned long _stageElapsed = 0;            // Time in stage seen by check() (ms)
+  unsigned long _histogram[MAX_STAGES][HISTOGRAM_BUCKETS];
+  void (*_restartCallback)() = NULL;
+
+  // Copy the breadcrumbs and max times into the RTC record and write it
+  void writeRTC();
+};
+
+
+#endif
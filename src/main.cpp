@@ -39,7 +39,32 @@ On start up:
 Running mode:
   1. LED starts off
   2. Double click toggle on or off
-  3. Press and hold to dim
+  3. Press and hold to dim - speeds up the longer it is held
+  3a. With SPECULATIVE_CLICK, a press when off starts dimming up from 0 straight away, and is undone if it
+      is let go before it counts as a single click (held for the double click period)
+  4. If auto off is set, fades off after that many minutes without a button press or Blynk change - any
+     activity during the fade stops it, leaving the output on
+  5. Scenes can be saved from the current output and recalled from Blynk, fading to the scene at its dim rate
+  6. Output calibration can be set from Blynk, one point or the duty limits at a time, or the whole table
+     in one write that is checked as a whole, and read back
+  7. Output usage (on time, off to on cycles and estimated energy) is sent to Blynk every minute and saved
+     every 6 hours and before a restart, including one by the software watchdog or a failed OTA. The output
+     power used for the energy estimate is set from Blynk
+
+Hangs:
+  1. Each stage of setup and loop leaves a breadcrumb, copied to RTC memory once a second by the hang check
+     timer, which survives a watchdog reset
+  2. A stage that takes longer than its budget restarts the ESP - waiting for config mode and wifi (which
+     includes the config portal) have no budget, as they wait on the user
+  3. On first connecting to Blynk, the reset reason, last stages and longest time in each stage before the
+     reset are sent
+
+Telemetry:
+  1. Health counters are sent to Blynk as one write, every minute by default
+
+OTA:
+  1. Output stays as it is while the image is transferred, and goes off only when the update is committed
+  2. Images may be gzip compressed - the core checks the MD5 as it streams and the boot loader unpacks it
 
  */
 
@@ -47,6 +72,7 @@ Running mode:
 #include <DebugUtils.h>
 
 //#define RESETSETTINGS
+//#define SPECULATIVE_CLICK
 
 extern "C" {
 #include "user_interface.h"
@@ -57,8 +83,12 @@ extern "C" {
 #include <ArduinoOTA.h>
 #include <BlynkSimpleEsp8266.h>
 #include <EepromUtil.h>
-#include "Switch_v2.h"
+#include "switch_v2.h"
 #include "PWM_LED_control.h"
+#include "click_actions.h"
+#include "auto_off.h"
+#include "reconnect_hold_off.h"
+#include "hang_detect.h"
 
 
 // Define GPIO pins and UART
@@ -88,11 +118,20 @@ const static int FLASH_VERYFAST = 100;
 
 pwmLED outputLED( OUTPUT_PIN, false, 100, LED_DIM_NORMAL, false, false );         // Main output LED
 
+pwmLEDGroup outputLEDs;     // All the dimmable outputs
+
 Ticker updateLEDs;          // LED update timer
 
-void updateLEDtick()
+unsigned long ledTickTime = 0;        // When the LED timer last ran
+unsigned long ledTickOverruns = 0;    // Times the LED timer ran late by more than a tick
+
+void IRAM_ATTR updateLEDtick()
 {
-  outputLED.autoDim();      // Move output LED to next dim level
+  unsigned long now = millis();
+  if( ledTickTime != 0 && now - ledTickTime >= 2 * LED_UPRATE_RATE ) ledTickOverruns++;
+  ledTickTime = now;
+
+  outputLEDs.autoDim();     // Move output LEDs to next dim level
 }
 
 
@@ -100,7 +139,7 @@ Ticker flashLEDs;                 // LED flash timer
 
 bool flashOrange = false;         // Is it flashing
 
-void flashLEDtick()
+void IRAM_ATTR flashLEDtick()
 {
   if( flashOrange ) digitalWrite(ORANGE_LED_PIN, !digitalRead(ORANGE_LED_PIN));
 }
@@ -118,6 +157,30 @@ const static char SSID_NAME[] = "Umbrella191";
 char blynk_token[34];                 // Blynk tokcen
 int add_blynk_token = 0;              // Address of token in EEPROM
 
+int autoOffMinutes = 0;               // Minutes of inactivity before fading off (0 = never)
+int add_auto_off = 40;                // Address of auto off in EEPROM
+
+const static int SCENE_COUNT = 8;     // Number of stored scenes
+pwmLEDScene scenes[SCENE_COUNT];      // Scenes, indexed by scene ID
+int add_scenes = 48;                  // Address of scenes in EEPROM
+
+pwmLEDCalibration outputCalibration;  // Calibration of main output
+int add_calibration = 176;            // Address of calibration in EEPROM
+
+dimAccel dimAcceleration;             // How hold to dim speeds up
+int add_dim_accel = 232;              // Address of dim acceleration in EEPROM
+
+int add_usage = 240;                  // Address of output usage in EEPROM
+
+int telemetryRate = 60;               // Seconds between telemetry sends (0 = never)
+int add_telemetry = 264;              // Address of telemetry rate in EEPROM
+
+int outputWatts = 10;                 // Output power at full duty (W), for energy estimate
+int add_output_watts = 268;           // Address of output power in EEPROM
+
+int savedDebounce = 0;                // Learned switch debounce last saved
+int add_debounce = 228;               // Address of learned debounce in EEPROM
+
 // Setup WifiManager
 
 WiFiManager wifiManager;  
@@ -130,7 +193,7 @@ bool shouldSaveConfig;                // has the config changed after running th
 
 void saveConfigCallback ()
 {
-  DEBUG_PRINTLN("Should save config");
+  DEBUG_PRINTLN(F("Should save config"));
   shouldSaveConfig = true;                // Need to save the new config to EEPROM
 }
 
@@ -138,7 +201,7 @@ void saveConfigCallback ()
 
 void configModeCallback (WiFiManager *myWiFiManager)
 {
-  DEBUG_PRINTLN("Entered config mode");
+  DEBUG_PRINTLN(F("Entered config mode"));
   DEBUG_PRINTLN(WiFi.softAPIP());
   DEBUG_PRINTLN(myWiFiManager->getConfigPortalSSID());    // If you used auto generated SSID, print it
 
@@ -146,6 +209,176 @@ void configModeCallback (WiFiManager *myWiFiManager)
 }
 
 
+// Auto off
+// --------
+
+const static int AUTO_OFF_MAX = 24*60;      // Longest auto off allowed (1 day)
+
+Ticker autoOffTimer;                        // Counts down the minutes to auto off
+
+autoOffControl autoOff( outputLED );        // Fades the output off after inactivity
+
+void autoOffTick()
+{
+  autoOff.tick();
+}
+
+// Restart the count down after any activity, and stop an auto off fade already going - call before acting
+// on the activity. The minute timer is started again too, so the first minute is a whole one rather than
+// what was left of the last
+
+void restartAutoOff()
+{
+  autoOff.setMinutes(autoOffMinutes);
+  autoOff.restart();
+
+  if( autoOffMinutes > 0 ) autoOffTimer.attach(60, autoOffTick);
+  else autoOffTimer.detach();
+}
+
+
+// Scenes
+// ------
+
+// Read scenes from EEPROM, replacing any that are blank or corrupt with off
+
+void loadScenes()
+{
+  EEPROM.get(add_scenes, scenes);
+
+  for( int i = 0; i < SCENE_COUNT; i++ )
+  {
+    pwmLEDScene &scene = scenes[i];
+    
+    if( scene.level < 0 || scene.level > 100 || scene.dimRate < 1 || scene.dimRate > 100 )
+    {
+      scene = { false, 0, LED_DIM_NORMAL, true, false, false };
+    }
+  }
+}
+
+// Store the current output as a scene
+
+void saveScene( int id )
+{
+  if( id < 0 || id >= SCENE_COUNT ) return;
+
+  scenes[id] = outputLED.getScene();
+  
+  EEPROM.put(add_scenes, scenes);
+  EEPROM.commit();
+}
+
+// Recall a scene - returns false if there is no such scene
+
+bool recallScene( int id )
+{
+  if( id < 0 || id >= SCENE_COUNT ) return false;
+
+  DEBUG_PRINT( F("Scene ") );
+  DEBUG_PRINTLN( id );
+
+  outputLED.fadeToScene( scenes[id] );
+
+  return true;
+}
+
+
+// Calibration
+// -----------
+
+// Read calibration from EEPROM - blank or corrupt leaves the default
+
+void loadCalibration()
+{
+  EEPROM.get(add_calibration, outputCalibration);
+
+  if( !outputLED.setCalibration(outputCalibration) ) outputCalibration = outputLED.getCalibration();
+}
+
+// Apply and store a changed calibration
+
+void saveCalibration()
+{
+  if( !outputLED.setCalibration(outputCalibration) )
+  {
+    DEBUG_PRINTLN( F("Calibration rejected") );
+    outputCalibration = outputLED.getCalibration();             // Go back to what is in use
+    return;
+  }
+
+  EEPROM.put(add_calibration, outputCalibration);
+  EEPROM.commit();
+}
+
+
+// Usage
+// -----
+
+const static int OUTPUT_WATTS = 10;                 // Default output power at full duty (W), for energy estimate
+const static int OUTPUT_WATTS_MAX = 5000;           // Most output power allowed (W)
+const static unsigned long USAGE_SEND_RATE = 60000UL;         // Send usage every minute
+const static unsigned long USAGE_SAVE_RATE = 6*3600000UL;     // Save usage every 6 hours
+
+unsigned long usageSendTime = 0;      // When usage last sent
+unsigned long usageSaveTime = 0;      // When usage last saved
+
+// Usage kept in RTC memory over a software watchdog restart - the watchdog runs from a timer, where a
+// flash write isn't safe, so it is written to flash on the next start instead
+
+const static uint32_t USAGE_RTC_OFFSET = 96;          // RTC user memory block, clear of the hang detector
+const static uint32_t USAGE_RTC_MAGIC = 0x55534147;   // Marks RTC memory as ours
+
+struct {
+  uint32_t magic;
+  pwmLEDUsage usage;
+} usageRTC;
+
+// Save usage to EEPROM
+
+void saveUsage()
+{
+  usageSaveTime = millis();
+
+  EEPROM.put(add_usage, outputLED.getUsage());
+  EEPROM.commit();
+}
+
+// Keep usage in RTC memory - safe from the software watchdog timer, just before it restarts
+
+void keepUsage()
+{
+  usageRTC.magic = USAGE_RTC_MAGIC;
+  usageRTC.usage = outputLED.getUsage();
+
+  ESP.rtcUserMemoryWrite( USAGE_RTC_OFFSET, (uint32_t *)&usageRTC, sizeof(usageRTC) );
+}
+
+// Read usage and output power from EEPROM - blank EEPROM starts from 0, at the default power
+
+void loadUsage()
+{
+  pwmLEDUsage usage;
+  
+  EEPROM.get(add_usage, usage);
+  if( usage.switchCycles == 0xFFFFFFFFUL ) usage = { 0, 0, 0 };
+
+  ESP.rtcUserMemoryRead( USAGE_RTC_OFFSET, (uint32_t *)&usageRTC, sizeof(usageRTC) );
+
+  bool fromRTC = usageRTC.magic == USAGE_RTC_MAGIC && usageRTC.usage.onMillis >= usage.onMillis;   // Kept over a watchdog restart
+  if( fromRTC ) usage = usageRTC.usage;
+
+  usageRTC.magic = 0;                                       // Only use it once
+  ESP.rtcUserMemoryWrite( USAGE_RTC_OFFSET, &usageRTC.magic, sizeof(usageRTC.magic) );
+
+  outputLED.setUsage(usage);
+  if( fromRTC ) saveUsage();
+
+  EEPROM.get(add_output_watts, outputWatts);
+  if( outputWatts < 0 || outputWatts > OUTPUT_WATTS_MAX ) outputWatts = OUTPUT_WATTS;
+}
+
+
 // Reset function
 // --------------
 
@@ -155,13 +388,14 @@ void doReset( bool hard = false )
     Serial.begin(SERIAL_SPEED);       // Turn on serial
   #endif
   
-  DEBUG_PRINTLN( "Starting reset" );
+  DEBUG_PRINTLN( F("Starting reset") );
 
   flashLEDs.attach_ms(FLASH_VERYFAST, flashLEDtick);   // Flash orange LED
   flashOrange = true;
   
   digitalWrite(BLUE_LED_PIN,LOW);
   outputLED.setState(false);
+  saveUsage();                        // Don't lose usage since last save
   
   delay(1000);
 
@@ -170,14 +404,14 @@ void doReset( bool hard = false )
    
     // Reset the Wifi settings
 
-    DEBUG_PRINTLN( "Clearing settings" );
+    DEBUG_PRINTLN( F("Clearing settings") );
 
     wifiManager.resetSettings();
   
     delay(1000);
   }
   
-  DEBUG_PRINTLN( "Reseting" );
+  DEBUG_PRINTLN( F("Reseting") );
   
   delay(5000);
 
@@ -200,19 +434,50 @@ void doReset( bool hard = false )
 #define BLNK_MAIN_BTN   2             // Virtual pin to match main button
 #define BLNK_DIMMER     3             // Virtual pin for dimmer slider
 #define BLNK_GAUGE      4             // Virtual pin for return level
+#define BLNK_AUTO_OFF   5             // Virtual pin to set auto off in minutes (0 = never)
+#define BLNK_SCENE      6             // Virtual pin to recall a scene by ID
+#define BLNK_SCENE_SAVE 7             // Virtual pin to save the current output as a scene ID
+#define BLNK_CAL_POINT  8             // Virtual pin to set a calibration point - point (0-10), duty (0-1023)
+#define BLNK_CAL_LIMITS 9             // Virtual pin to set the calibration duty limits - min, max
+#define BLNK_CAL_RESET  10            // Virtual pin to go back to default calibration
+#define BLNK_HEAP       11            // Virtual pin to read heap use
+#define BLNK_DEBOUNCE   12            // Virtual pin to read learned switch debounce
+#define BLNK_DIM_ACCEL  13            // Virtual pin to set hold to dim speed up - fast after, very fast after (ms)
+#define BLNK_USAGE      14            // Virtual pin for output usage - on minutes, off to on cycles, energy (Wh)
+#define BLNK_HANG       15            // Virtual pin for last reset - reason, stage restarted in, last 4 stages, max time in each stage (ms)
+#define BLNK_HANG_HIST  16            // Virtual pin to get a stage's times - write stage, returns stage, max (ms), histogram
+#define BLNK_TELEMETRY  17            // Virtual pin for health telemetry - see sendTelemetry()
+#define BLNK_TELEMETRY_RATE 18        // Virtual pin to set seconds between telemetry sends (0 = never)
+#define BLNK_CAL_TABLE  19            // Virtual pin for the whole calibration - points 0-10, min, max
+#define BLNK_OUTPUT_WATTS 20          // Virtual pin to set output power at full duty (W), for energy estimate
 #define BLNK_RESET      30            // Virtual pin to trigger a reset
 #define BLNK_HARDRESET  31            // Virtual pin to trigger a hard reset (clearing wifi settings)
 
+const static int RECONNECT_JITTER = 10000;        // Spread reconnects over 10s so all the units on a site don't hit the server at once
+
 const static char BLNK_PARAM_PROMPT[] = "Enter Blynk token";
 const static char BLNK_PARAM_ID[] = "blnk_token";
 
+// Captive Portal parameter for Blynk token - WiFiManager keeps a pointer to it, so it can't be on the stack
+
+WiFiManagerParameter custom_blynk_token(BLNK_PARAM_ID, BLNK_PARAM_PROMPT, blynk_token, sizeof(blynk_token));
+
+// Hold off reconnecting for a random time after losing the server - not before the first connect
+
+reconnectHoldOff blynkHoldOff( RECONNECT_JITTER );
+
+bool blynkRunDue()
+{
+  return blynkHoldOff.due( Blynk.connected() );
+}
+
 // Functions called on Blynk actions
 
 // Initiate reset
 
 BLYNK_WRITE(BLNK_RESET)
 {
-  DEBUG_PRINTLN( "Blynk reset" );
+  DEBUG_PRINTLN( F("Blynk reset") );
 
   doReset();                    // Soft reset
 }
@@ -221,7 +486,7 @@ BLYNK_WRITE(BLNK_RESET)
 
 BLYNK_WRITE(BLNK_HARDRESET)
 {
-  DEBUG_PRINTLN( "Blynk hard reset" );
+  DEBUG_PRINTLN( F("Blynk hard reset") );
 
   doReset(true);                // Hard reset (clear settings)
 }
@@ -230,6 +495,7 @@ BLYNK_WRITE(BLNK_HARDRESET)
 
 BLYNK_WRITE(BLNK_MAIN_BTN)
 {
+  restartAutoOff();
   if( param.asInt() != 0 ) outputLED.toggleState();                   // Toggle LED state
   Blynk.virtualWrite(BLYK_MAIN_LED, outputLED.getState()*255);        // Update Blynk LED
 }
@@ -238,19 +504,374 @@ BLYNK_WRITE(BLNK_MAIN_BTN)
 
 BLYNK_WRITE(BLNK_DIMMER)
 {
+  restartAutoOff();
   outputLED.setLevel( param.asInt() );                        // Virtual pin set 0-100
   Blynk.virtualWrite(BLNK_GAUGE, outputLED.getLevel());       // update Blynk gauge
 }
 
+// Scene recalled
+
+BLYNK_WRITE(BLNK_SCENE)
+{
+  int id = param.asInt();
+
+  restartAutoOff();                                                   // First, so it doesn't stop the scene's fade
+  if( !recallScene( id ) ) return;
+
+  // The output is still fading, so show where it is going rather than where it is
+
+  Blynk.virtualWrite(BLYK_MAIN_LED, scenes[id].state*255);            // Update Blynk LED
+  Blynk.virtualWrite(BLNK_GAUGE, scenes[id].level);                   // update Blynk gauge
+}
+
+// Scene saved
+
+BLYNK_WRITE(BLNK_SCENE_SAVE)
+{
+  saveScene( param.asInt() );
+}
+
+// Calibration point changed
+
+BLYNK_WRITE(BLNK_CAL_POINT)
+{
+  int point = param[0].asInt();
+  
+  if( point < 0 || point >= PWM_LED_CAL_POINTS ) return;
+  
+  outputCalibration.points[point] = param[1].asInt();
+  saveCalibration();
+}
+
+// Calibration limits changed
+
+BLYNK_WRITE(BLNK_CAL_LIMITS)
+{
+  outputCalibration.minPWM = param[0].asInt();
+  outputCalibration.maxPWM = param[1].asInt();
+  saveCalibration();
+}
+
+// Whole calibration changed - all points then the limits, applied only if the whole table is good
+
+BLYNK_WRITE(BLNK_CAL_TABLE)
+{
+  int count = 0;
+  for( BlynkParam::iterator it = param.begin(); it < param.end(); ++it ) count++;
+
+  if( count != PWM_LED_CAL_POINTS + 2 ) return;
+
+  pwmLEDCalibration calibration;
+
+  for( int i = 0; i < PWM_LED_CAL_POINTS; i++ ) calibration.points[i] = param[i].asInt();
+  calibration.minPWM = param[PWM_LED_CAL_POINTS].asInt();
+  calibration.maxPWM = param[PWM_LED_CAL_POINTS + 1].asInt();
+
+  outputCalibration = calibration;
+  saveCalibration();                    // Goes back to what is in use if any of it is bad
+}
+
+// Whole calibration requested
+
+BLYNK_READ(BLNK_CAL_TABLE)
+{
+  const pwmLEDCalibration &cal = outputCalibration;
+
+  Blynk.virtualWrite(BLNK_CAL_TABLE, cal.points[0], cal.points[1], cal.points[2], cal.points[3], cal.points[4],
+    cal.points[5], cal.points[6], cal.points[7], cal.points[8], cal.points[9], cal.points[10], cal.minPWM, cal.maxPWM);
+}
+
+// Calibration reset
+
+BLYNK_WRITE(BLNK_CAL_RESET)
+{
+  if( param.asInt() == 0 ) return;
+
+  outputLED.resetCalibration();
+  outputCalibration = outputLED.getCalibration();
+  saveCalibration();
+}
+
+// Auto off changed
+
+BLYNK_WRITE(BLNK_AUTO_OFF)
+{
+  autoOffMinutes = constrain( param.asInt(), 0, AUTO_OFF_MAX );
+
+  EEPROM.put(add_auto_off, autoOffMinutes);                   // Keep it over a restart
+  EEPROM.commit();
+
+  restartAutoOff();
+}
+
+
+// Heap monitoring
+// ---------------
+
+// Nothing in the main loop should allocate, so after setup the free heap should
+// only move with library buffers. Track the worst seen so slow leaks and
+// fragmentation from reconnects show up.
+
+const static int HEAP_CHECK_RATE = 1000;      // Check heap every second
+
+uint32_t heapAtBoot = 0;                      // Free heap at the end of setup
+uint32_t heapLowWater = 0;                    // Least free heap seen since
+uint8_t heapFragHighWater = 0;                // Worst fragmentation seen (%)
+unsigned long heapCheckTime = 0;              // When we last looked
+
+void checkHeap()
+{
+  if( (unsigned long)(millis() - heapCheckTime) < HEAP_CHECK_RATE ) return;
+  heapCheckTime = millis();
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint8_t frag = ESP.getHeapFragmentation();
+
+  if( frag > heapFragHighWater ) heapFragHighWater = frag;
+
+  if( freeHeap < heapLowWater )
+  {
+    heapLowWater = freeHeap;
+
+    DEBUG_PRINT(F("Heap low water: "));
+    DEBUG_PRINT( heapLowWater );
+    DEBUG_PRINT(F(", used since boot: "));
+    DEBUG_PRINTLN( heapAtBoot - heapLowWater );
+  }
+}
+
+// Heap requested - free heap at boot, low water and fragmentation high water
+
+BLYNK_READ(BLNK_HEAP)
+{
+  Blynk.virtualWrite(BLNK_HEAP, heapAtBoot, heapLowWater, heapFragHighWater);
+}
+
+
+// Send usage to Blynk in one write, and save it now and again
+
+void checkUsage()
+{
+  if( (unsigned long)(millis() - usageSendTime) < USAGE_SEND_RATE ) return;
+  usageSendTime = millis();
+
+  pwmLEDUsage usage = outputLED.getUsage();
+
+  unsigned long onMinutes = usage.onMillis / 60000ULL;
+  unsigned long energy = ( usage.dutyMillis * outputWatts ) / ( 1023ULL * 3600000ULL );     // Wh
+
+  Blynk.virtualWrite(BLNK_USAGE, onMinutes, usage.switchCycles, energy);
+
+  if( (unsigned long)(millis() - usageSaveTime) >= USAGE_SAVE_RATE ) saveUsage();
+}
+
+// Output power changed - energy is worked out from the whole duty total, so this applies to past use too
+
+BLYNK_WRITE(BLNK_OUTPUT_WATTS)
+{
+  outputWatts = constrain( param.asInt(), 0, OUTPUT_WATTS_MAX );
+
+  EEPROM.put(add_output_watts, outputWatts);
+  EEPROM.commit();
+
+  usageSendTime = millis() - USAGE_SEND_RATE;           // Send the new estimate next time round
+}
+
+
+// Hang detection
+// --------------
+
+// Stages of setup and loop, and the most time (ms) allowed in each (0 = no limit)
+
+enum { STAGE_SETUP, STAGE_CONFIG_WAIT, STAGE_WIFI, STAGE_SETUP_OTA, STAGE_OTA, STAGE_BLYNK, STAGE_PAYLOAD, STAGE_COUNT };
+
+const static unsigned long STAGE_BUDGETS[STAGE_COUNT] = {
+  30000,                                // STAGE_SETUP
+  0,                                    // STAGE_CONFIG_WAIT - holding the button keeps it waiting
+  0,                                    // STAGE_WIFI - includes the config portal, which waits while it is in use
+  30000,                                // STAGE_SETUP_OTA
+  300000,                               // STAGE_OTA - includes the whole upgrade
+  60000,                                // STAGE_BLYNK - includes reconnecting
+  30000                                 // STAGE_PAYLOAD - includes reset delays
+};
+
+const static int HANG_CHECK_RATE = 1000;      // Check for hangs every second
+
+hangDetector hangs( STAGE_BUDGETS, STAGE_COUNT );
+
+Ticker hangCheck;                     // Software watchdog timer
+
+bool hangReported = false;            // Sent last reset to Blynk
+
+unsigned long blynkConnects = 0;      // Times connected to Blynk, including the first
+
+void hangCheckTick()
+{
+  hangs.check( HANG_CHECK_RATE );
+}
+
+// Send last reset once we first connect
+
+BLYNK_CONNECTED()
+{
+  blynkConnects++;
+
+  if( hangReported ) return;
+  hangReported = true;
+
+  Blynk.virtualWrite(BLNK_HANG, hangs.getResetReason(), hangs.getTrippedStage(),
+    hangs.getLastStage(0), hangs.getLastStage(1), hangs.getLastStage(2), hangs.getLastStage(3),
+    hangs.getLastMaxTime(STAGE_SETUP), hangs.getLastMaxTime(STAGE_CONFIG_WAIT), hangs.getLastMaxTime(STAGE_WIFI),
+    hangs.getLastMaxTime(STAGE_SETUP_OTA), hangs.getLastMaxTime(STAGE_OTA), hangs.getLastMaxTime(STAGE_BLYNK),
+    hangs.getLastMaxTime(STAGE_PAYLOAD));
+}
+
+// Stage times requested
+
+BLYNK_WRITE(BLNK_HANG_HIST)
+{
+  uint8_t id = param.asInt();
+  const unsigned long *histogram = hangs.getHistogram(id);
+
+  if( histogram == NULL ) return;
+
+  Blynk.virtualWrite(BLNK_HANG_HIST, id, hangs.getMaxTime(id),
+    histogram[0], histogram[1], histogram[2], histogram[3], histogram[4], histogram[5], histogram[6], histogram[7]);
+}
+
+
+// Telemetry
+// ---------
+
+const static int TELEMETRY_MAX = 24*3600;       // Longest time between sends (1 day)
+
+unsigned long loopCount = 0;          // Loops since last send
+unsigned long telemetryTime = 0;      // When last sent
+unsigned long uptimeSeconds = 0;      // Added up every loop, so it carries on past millis() wrapping
+unsigned long uptimeMillis = 0;       // Part second not yet added to uptimeSeconds
+unsigned long uptimeTime = 0;         // When last added up
+unsigned long telemetryCost = 0;      // Time the last send took to gather (us)
+
+// Gather counters and send them in one write:
+// uptime (s), free heap, heap low water, fragmentation high water (%), RSSI (dBm),
+// Blynk connects, loops per second, LED timer overruns, gather time (us)
+
+void sendTelemetry()
+{
+  unsigned long now = millis();
+
+  uptimeMillis += now - uptimeTime;                 // Even when not sending, so no wrap of millis() is missed
+  uptimeTime = now;
+  while( uptimeMillis >= 1000 )
+  {
+    uptimeMillis -= 1000;
+    uptimeSeconds++;
+  }
+
+  if( telemetryRate == 0 ) return;
+
+  unsigned long elapsed = now - telemetryTime;
+  if( elapsed < telemetryRate * 1000UL ) return;
+
+  uint32_t start = ESP.getCycleCount();
+
+  telemetryTime = now;
+
+  unsigned long loopRate = loopCount * 1000UL / elapsed;
+  loopCount = 0;
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  int32_t rssi = WiFi.RSSI();
+
+  telemetryCost = ( ESP.getCycleCount() - start ) / ESP.getCpuFreqMHz();   // Before the send, which can block
+
+  Blynk.virtualWrite(BLNK_TELEMETRY, uptimeSeconds, freeHeap, heapLowWater, heapFragHighWater, rssi,
+    blynkConnects, loopRate, ledTickOverruns, telemetryCost);
+}
+
+// Telemetry rate changed
+
+BLYNK_WRITE(BLNK_TELEMETRY_RATE)
+{
+  telemetryRate = constrain( param.asInt(), 0, TELEMETRY_MAX );
+
+  EEPROM.put(add_telemetry, telemetryRate);
+  EEPROM.commit();
+}
+
 
 // Switch functions
 // ----------------
 
 const static int LONG_PRESS = 10000;       // Need to press for 20s to initiate long press
-const static int DEBOUNCE = 50;            // 50ms for switch debounce
+const static int DEBOUNCE = 50;            // 50ms for switch debounce - most it can be
+const static int DEBOUNCE_MIN = 15;        // Least the debounce can learn down to
+const static int DEBOUNCE_SAVE = 5;        // Save learned debounce when it moves by 5ms
+const static int DIM_FAST_AFTER = 500;     // Default hold before dimming fast
+const static int DIM_VERYFAST_AFTER = 1000;   // Default hold before dimming very fast
 const static int START_TIME = 10000;       // 10 secs at start up to go into config mode
 
 Switch actionBtn(INPUT_PIN, INPUT, LOW, DEBOUNCE, LONG_PRESS );         // Setup switch management
+clickActions buttonActions( actionBtn, outputLED, LED_DIM_NORMAL, LED_DIM_FAST, LED_DIM_VERYFAST );   // What the button does to the output
+
+// Read learned debounce from EEPROM - blank EEPROM reads -1, so starts from the most
+
+void loadDebounce()
+{
+  actionBtn.setAdaptiveDebounce(DEBOUNCE_MIN);
+
+  EEPROM.get(add_debounce, savedDebounce);
+  if( savedDebounce >= DEBOUNCE_MIN && savedDebounce <= DEBOUNCE ) actionBtn.setDebouncePeriod(savedDebounce);
+
+  savedDebounce = actionBtn.getDebouncePeriod();
+}
+
+// Save learned debounce only once it has moved far enough, to save wear on the flash
+
+void saveDebounce()
+{
+  int debounce = actionBtn.getDebouncePeriod();
+
+  if( abs(debounce - savedDebounce) < DEBOUNCE_SAVE ) return;
+
+  savedDebounce = debounce;
+  EEPROM.put(add_debounce, savedDebounce);
+  EEPROM.commit();
+}
+
+// Debounce requested - debounce in use, average and peak bounce seen (ms)
+
+BLYNK_READ(BLNK_DEBOUNCE)
+{
+  Blynk.virtualWrite(BLNK_DEBOUNCE, actionBtn.getDebouncePeriod(), actionBtn.getBounceAverage(), actionBtn.getBouncePeak());
+}
+
+
+// Read dim acceleration from EEPROM - blank EEPROM reads -1, so use defaults
+
+void loadDimAccel()
+{
+  EEPROM.get(add_dim_accel, dimAcceleration);
+
+  if( dimAcceleration.fastAfter < 0 || dimAcceleration.veryFastAfter < 0 )
+  {
+    dimAcceleration = { DIM_FAST_AFTER, DIM_VERYFAST_AFTER };
+  }
+
+  buttonActions.setAcceleration(dimAcceleration);
+}
+
+// Dim acceleration changed
+
+BLYNK_WRITE(BLNK_DIM_ACCEL)
+{
+  dimAcceleration.fastAfter = max( param[0].asInt(), 0 );
+  dimAcceleration.veryFastAfter = max( param[1].asInt(), 0 );
+  buttonActions.setAcceleration(dimAcceleration);
+
+  EEPROM.put(add_dim_accel, dimAcceleration);
+  EEPROM.commit();
+}
 
 
 // Main Setup
@@ -260,6 +881,10 @@ bool isOnline = false;          // Did we initially get connecteed
 
 void setup()
 {     
+  hangs.begin();                                          // See where the last run got to
+  hangs.stage(STAGE_SETUP);
+  hangCheck.attach_ms(HANG_CHECK_RATE, hangCheckTick);
+
 #ifdef DEBUG
   pinMode(DEBUG_PIN,OUTPUT);
 #endif
@@ -272,14 +897,32 @@ void setup()
   
   EEPROM.begin(EEPROM_MAX);
 
+  EEPROM.get(add_auto_off, autoOffMinutes);                 // Read auto off - blank EEPROM reads as -1
+  if( autoOffMinutes < 0 || autoOffMinutes > AUTO_OFF_MAX ) autoOffMinutes = 0;
+
+  loadScenes();
+  loadCalibration();
+  loadDebounce();
+  loadDimAccel();
+#ifdef SPECULATIVE_CLICK
+  buttonActions.setSpeculative(true);                       // Start dimming on the press, not the single click
+#endif
+  loadUsage();
+  hangs.setRestartCallback(keepUsage);                      // Don't lose usage if the software watchdog restarts - only once it is loaded
+
+  EEPROM.get(add_telemetry, telemetryRate);                 // Read telemetry rate - blank EEPROM reads as -1
+  if( telemetryRate < 0 || telemetryRate > TELEMETRY_MAX ) telemetryRate = 60;
+
   // Setup LEDs
 
   pinMode(ORANGE_LED_PIN, OUTPUT);
   pinMode(BLUE_LED_PIN,OUTPUT);
   digitalWrite(ORANGE_LED_PIN,LOW);
   digitalWrite(BLUE_LED_PIN,LOW);   
+  outputLEDs.add(&outputLED);
   updateLEDs.attach_ms(LED_UPRATE_RATE, updateLEDtick);   // start LED update timer
   flashLEDs.attach_ms(FLASH_NORMAL, flashLEDtick);   // start LED update timer
+  restartAutoOff();                                  // start auto off minute count
 
   flashOrange = true;
 
@@ -287,26 +930,27 @@ void setup()
   
   #ifdef DEBUG
     Serial.begin(SERIAL_SPEED);
-    DEBUG_PRINTLN( "" );
-    DEBUG_PRINTLN( "" );
-    DEBUG_PRINTLN("--------------");
-    DEBUG_PRINTLN(" Blynk Switch ");
-    DEBUG_PRINTLN("--------------");
-    DEBUG_PRINTLN( "" );
-    DEBUG_PRINTLN("Debug ON");
+    DEBUG_PRINTLN( F("") );
+    DEBUG_PRINTLN( F("") );
+    DEBUG_PRINTLN(F("--------------"));
+    DEBUG_PRINTLN(F(" Blynk Switch "));
+    DEBUG_PRINTLN(F("--------------"));
+    DEBUG_PRINTLN( F("") );
+    DEBUG_PRINTLN(F("Debug ON"));
   #else
     wifiManager.setDebugOutput(false);
   #endif
 
 #ifdef RESETSETTINGS
     // Reset the Wifi settings
-    DEBUG_PRINTLN( "Clearing settings" );
+    DEBUG_PRINTLN( F("Clearing settings") );
     wifiManager.resetSettings();
 
     delay(1000);
 #else
 
-  DEBUG_PRINTLN("Waiting for config mode request");
+  hangs.stage(STAGE_CONFIG_WAIT);
+  DEBUG_PRINTLN(F("Waiting for config mode request"));
   delay(1000);
 
   unsigned const long interval = START_TIME; // the time we need to wait
@@ -324,18 +968,19 @@ void setup()
     if(actionBtn.longPress())           // If long press then reset setttings
     {
       // Reset the Wifi settings
-      DEBUG_PRINTLN( "Clearing settings" );
+      DEBUG_PRINTLN( F("Clearing settings") );
       wifiManager.resetSettings();
 
       break;     // Its a log press so keep going
     }
   }
-  DEBUG_PRINTLN("Continue");
+  DEBUG_PRINTLN(F("Continue"));
 
 #endif
   
+  hangs.stage(STAGE_WIFI);
+
   // Add Captive Portal parameter for Blynk token
-  WiFiManagerParameter custom_blynk_token(BLNK_PARAM_ID, BLNK_PARAM_PROMPT, blynk_token, 34);
   wifiManager.addParameter(&custom_blynk_token);
 
   // Setup WiFi Manager call backs
@@ -348,46 +993,49 @@ void setup()
 
   isOnline = wifiManager.autoConnect( SSID_NAME );            // Try to connect to Wifi - if not, the run captive portal
   
-  if( !isOnline ) DEBUG_PRINTLN("Failed to connect and hit timeout");
+  hangs.stage(STAGE_SETUP);
+
+  if( !isOnline ) DEBUG_PRINTLN(F("Failed to connect and hit timeout"));
   
   if( shouldSaveConfig )                                     // If new config loaded, then save to EEPROM
   {
-    strcpy(blynk_token, custom_blynk_token.getValue());      // Copy values from parameters
+    strlcpy(blynk_token, custom_blynk_token.getValue(), sizeof(blynk_token));      // Copy values from parameters
 
-    DEBUG_PRINT( "New token: -" );
+    DEBUG_PRINT( F("New token: -") );
     DEBUG_PRINT( blynk_token );
-    DEBUG_PRINTLN( "-" );
+    DEBUG_PRINTLN( F("-") );
     
-    DEBUG_PRINTLN( "Writing to EEPROM" );
+    DEBUG_PRINTLN( F("Writing to EEPROM") );
     EepromUtil::eeprom_write_string(0, blynk_token);
     EEPROM.commit();
   }
   else
   {
-    DEBUG_PRINTLN( "Using saved token" );
+    DEBUG_PRINTLN( F("Using saved token") );
   }
 
   if( isOnline )
   {
-    EepromUtil::eeprom_read_string(0, blynk_token, 34 );      // Read Blynk token from EEPROM
+    EepromUtil::eeprom_read_string(0, blynk_token, sizeof(blynk_token) );      // Read Blynk token from EEPROM
   
-    DEBUG_PRINT( "Read token: -" );
+    DEBUG_PRINT( F("Read token: -") );
     DEBUG_PRINT( blynk_token ); 
-    DEBUG_PRINTLN( "-" );
+    DEBUG_PRINTLN( F("-") );
 
     Blynk.config(blynk_token);                 // Configure Blynk session
   }
 
   if( isOnline )
   {
-    DEBUG_PRINTLN( "Setting up OTA" );
+    hangs.stage(STAGE_SETUP_OTA);
+    DEBUG_PRINTLN( F("Setting up OTA") );
 
     ArduinoOTA.setHostname(SSID_NAME);
     ArduinoOTA.onStart([]()
     {
-      // Switch off things during upgrade
+      // Switch off things during upgrade - leave the output as it is until the end
 
-      analogWrite(OUTPUT_PIN, 0);
+      saveUsage();
       Serial.end();
 
       // Set LEDs
@@ -398,6 +1046,11 @@ void setup()
   
     ArduinoOTA.onEnd([]()
     {
+      // Switch off output now the update is committed
+
+      updateLEDs.detach();
+      analogWrite(OUTPUT_PIN, 0);
+
       // do a fancy thing with LED at end
       
       for (int i=0;i<20;i++)
@@ -413,18 +1066,27 @@ void setup()
       digitalWrite(BLUE_LED_PIN,LOW);      
     });
   
-    ArduinoOTA.onError([](ota_error_t error) { ESP.restart(); });
+    ArduinoOTA.onError([](ota_error_t error)
+    {
+      saveUsage();                    // Don't lose usage since last save
+      ESP.restart();
+    });
   
     ArduinoOTA.begin();   // setup the OTA server
   
     delay(1000);
   }
 
-  DEBUG_PRINTLN( "Up and running ..." );
+  hangs.stage(STAGE_SETUP);
+  DEBUG_PRINTLN( F("Up and running ...") );
 
   flashOrange = false;
   
   delay(1000);
+
+  heapAtBoot = heapLowWater = ESP.getFreeHeap();          // Start of steady state
+  loopCount = 0;                                          // First loop rate sent is of loop() alone
+  telemetryTime = millis();
 }
 
 
@@ -440,10 +1102,14 @@ void loop()
 
   if( isOnline )
   {
+    hangs.stage(STAGE_OTA);
     ArduinoOTA.handle();    // Handle OTA
-    Blynk.run();            // Let Blynk do its stuff - it will also try to reconnect wifi if disconnected
+    hangs.stage(STAGE_BLYNK);
+    if( blynkRunDue() ) Blynk.run();            // Let Blynk do its stuff - it will also try to reconnect wifi if disconnected
   }
 
+  hangs.stage(STAGE_PAYLOAD);
+
 #ifdef DEBUG
   digitalWrite(DEBUG_PIN,LOW);
 #endif
@@ -455,24 +1121,22 @@ void loop()
   digitalWrite(BLUE_LED_PIN,(!actionBtn.on())^(!isOnline));  // If online then blue flashing and orange when pressed
   digitalWrite(ORANGE_LED_PIN,(!actionBtn.on())^(isOnline)); // If offline then vise versa
 
-  if( actionBtn.doubleClick() )                     // Toggle on/offf
+  if( actionBtn.switched() )                                            // Any button activity - before acting on it
   {
-    if( outputLED.getLevel() == 0 )                 // If off then set dim to full on
-    {
-      outputLED.setLevel(100);
-      outputLED.setDimDirection(true);
-    }
-    outputLED.toggleState();                                            // If double click then toggle state
+    restartAutoOff();
+    saveDebounce();
   }
-  else if( actionBtn.released() ) outputLED.toggleDimDirection();       // Change dim direction on release
-  else if( outputLED.getState() ) outputLED.dimLED(actionBtn.on());     // Dim if on and pushed
-  else if( actionBtn.singleClick() )                                    // Click to dim
-  {
-      outputLED.setLevel(0);
-      outputLED.setDimDirection(true);
-      outputLED.setState(true);
-  }
-   
+
+  buttonActions.process();                                              // Dim, toggle and click actions
+
   if(actionBtn.longPress()) doReset();                                  // If long press then restart
+
+  autoOff.process();                                                    // Fade off if it is time
+
+  checkHeap();
+  checkUsage();
+  sendTelemetry();
+
+  loopCount++;
 }
 
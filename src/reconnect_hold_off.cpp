@@ -0,0 +1,67 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Chris Gregg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+-------------------------------------------------------------------------------------
+
+Holds off reconnecting to a server for a random time after losing it, so that all
+the units on a site don't hit the server at the same moment after a router or
+power restart.
+
+Call due() each loop with whether the connection is up. It returns true when the
+connection should be run - always while connected, and while disconnected once
+the hold off has passed. The hold off starts when the connection is first seen to
+be down, and is a random time up to maxDelay. Until the first connect after boot
+there is no hold off, so start up isn't slowed.
+
+*/
+
+#include "reconnect_hold_off.h"
+
+
+// Constructor
+reconnectHoldOff::reconnectHoldOff( unsigned long maxDelay )
+{
+  _maxDelay = maxDelay;
+}
+
+
+// Should the connection be run now
+bool reconnectHoldOff::due( bool connected )
+{
+  if( connected )
+  {
+    _everConnected = true;
+    _waiting = false;
+    return true;
+  }
+
+  if( !_everConnected ) return true;              // First connect after boot - no hold off
+
+  if( !_waiting )                                 // Just lost it
+  {
+    _waiting = true;
+    _start = millis();
+    _delay = _maxDelay > 0 ? random(_maxDelay) : 0;
+  }
+
+  return (unsigned long)(millis() - _start) >= _delay;
+}
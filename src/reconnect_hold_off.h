@@ -0,0 +1,31 @@
+#ifndef RECONNECT_HOLD_OFF_H
+#define RECONNECT_HOLD_OFF_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+
+class reconnectHoldOff {
+
+public:
+
+  // Constructor - maxDelay is the longest hold off (ms), 0 for none
+  reconnectHoldOff( unsigned long maxDelay );
+
+  // Should the connection be run now - call each loop with whether it is up
+  bool due( bool connected );
+
+private:
+
+  unsigned long _maxDelay;
+  bool _everConnected = false;        // Connected since boot
+  bool _waiting = false;              // Lost the connection and holding off
+  unsigned long _start = 0;           // When we noticed
+  unsigned long _delay = 0;           // How long to hold off for
+};
+
+
+#endif
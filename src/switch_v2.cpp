@@ -21,6 +21,17 @@ added deglitching
 
 Modified with addition of SingleClick by Chris Gregg, 2016
 
+Added poll(input, ms) so a recorded timeline can be replayed without hardware.
+Added adaptive debounce: edges seen within the constructor debounce period after a
+switch are bounce, and the window is set to 1.5x the larger of the decaying peak
+bounce and the average bounce, plus deglitchPeriod (a bounce is only seen as a
+switch once it has been steady that long), kept between minPeriod and the
+constructor value. Bounce is measured against the constructor value, not the
+learned window, and a switch the constructor value would have held off counts as
+bounce, so the window grows back straight away if the switch gets worse.
+All state is initialised in the constructor so the first push after boot is
+not taken as the second half of a double click against pushedTime 0.
+
 
 ..........................................DEGLITCHING..............................
                                            
@@ -104,17 +115,32 @@ Modified with addition of SingleClick by Chris Gregg, 2016
 */
 
 #include <Arduino.h>
-#include "Switch_v2.h"
+#include "switch_v2.h"
                
 Switch::Switch(byte _pin, byte PinMode, bool polarity, int debouncePeriod, int longPressPeriod, int doubleClickPeriod, int deglitchPeriod):
-pin(_pin), polarity(polarity), deglitchPeriod(deglitchPeriod), debouncePeriod(debouncePeriod), longPressPeriod(longPressPeriod), doubleClickPeriod(doubleClickPeriod)
+pin(_pin), polarity(polarity), deglitchPeriod(deglitchPeriod), longPressPeriod(longPressPeriod), doubleClickPeriod(doubleClickPeriod), maxDebouncePeriod(debouncePeriod)
 { pinMode(pin, PinMode);
-  switchedTime = millis();
-  debounced = digitalRead(pin);
+  this->debouncePeriod = debouncePeriod;
+  ms = millis();
+  deglitchTime = ms;
+  switchedTime = ms - debouncePeriod; // no debounce or bounce against a switch that never happened
+  pushedTime = ms - doubleClickPeriod; // no double click or long press against a push that never happened
+  debounced = deglitched = input = lastInput = digitalRead(pin);
+  equal = true;
+  _switched = _longPress = _doubleClick = _singleClick = false;
+  longPressDisable = singleClickStarted = false;
+  minDebouncePeriod = lastBounce = bounceAverage8 = bouncePeak = 0;
 }
   
 bool Switch::poll()
 { input = digitalRead(pin);
+  ms = millis();
+  return process();
+}
+
+bool Switch::poll(bool _input, unsigned long _ms)
+{ input = _input;
+  ms = _ms;
   return process();
 }
  
@@ -127,11 +153,11 @@ bool Switch::process()
 }
  
 void inline Switch::deglitch()
-{ ms = millis();
-  if(input == lastInput) equal = 1;
+{ if(input == lastInput) equal = 1;
   else
   { equal = 0;
     deglitchTime = ms;
+    if((ms - switchedTime) < (unsigned long)maxDebouncePeriod) lastBounce = ms - switchedTime; // bounce after the last switch
   }
   if(equal & ((ms - deglitchTime) > deglitchPeriod)) // max 50ms, disable deglitch: 0ms
   { deglitched = input;
@@ -141,10 +167,11 @@ void inline Switch::deglitch()
 }
  
 void inline Switch::debounce()
-{ ms = millis();
-  _switched = 0;
+{ _switched = 0;
   if((deglitched != debounced) & ((ms - switchedTime) >= debouncePeriod))
-  { switchedTime = ms;
+  { if((ms - switchedTime) < (unsigned long)maxDebouncePeriod) lastBounce = ms - switchedTime; // the constructor period would have held this off, so it is bounce too
+    adaptDebounce(); // window of the last switch is over
+    switchedTime = ms;
     debounced = deglitched;
     _switched = 1;
     singleClickStarted = false;
@@ -172,6 +199,39 @@ void inline Switch::calcLongPress()
   } 
 }
  
+void inline Switch::adaptDebounce()
+{ if(minDebouncePeriod)
+  { bounceAverage8 += lastBounce - bounceAverage8 / 8; // 8x running average
+    bouncePeak = lastBounce > bouncePeak ? lastBounce : bouncePeak - (bouncePeak + 15) / 16; // decays if not topped up
+    int bounce = bouncePeak > bounceAverage8 / 8 ? bouncePeak : bounceAverage8 / 8;
+    debouncePeriod = constrain(bounce * 3 / 2 + deglitchPeriod, minDebouncePeriod, maxDebouncePeriod);
+  }
+  lastBounce = 0;
+}
+
+void Switch::setAdaptiveDebounce(int minPeriod)
+{ minDebouncePeriod = constrain(minPeriod, 0, maxDebouncePeriod);
+  if(!minDebouncePeriod) debouncePeriod = maxDebouncePeriod;
+}
+
+void Switch::setDebouncePeriod(int period)
+{ debouncePeriod = constrain(period, minDebouncePeriod, maxDebouncePeriod);
+  bouncePeak = debouncePeriod > deglitchPeriod ? (debouncePeriod - deglitchPeriod) * 2 / 3 : 0; // seed the statistics to match, so the next switch doesn't undo it
+  bounceAverage8 = bouncePeak * 8;
+}
+
+int Switch::getDebouncePeriod()
+{ return debouncePeriod;
+}
+
+int Switch::getBounceAverage()
+{ return bounceAverage8 / 8;
+}
+
+int Switch::getBouncePeak()
+{ return bouncePeak;
+}
+
 bool Switch::switched()
 { return _switched;
 }
@@ -188,6 +248,10 @@ bool Switch::released()
 { return _switched && (debounced^polarity);
 }
  
+unsigned long Switch::onTime()
+{ return on() ? ms - pushedTime : 0;
+}
+
 bool Switch::longPress()
 { return _longPress;
 }
@@ -19,6 +19,7 @@ class Switch
 public:
   Switch(byte _pin, byte PinMode=INPUT_PULLUP, bool polarity=LOW, int debouncePeriod=50, int longPressPeriod=300, int doubleClickPeriod=250, int deglitchPeriod=10);
   bool poll(); // Returns 1 if switched  
+  bool poll(bool _input, unsigned long _ms); // as poll(), with input and time supplied by the caller e.g. host simulation
   bool switched(); // will be refreshed by poll()
   bool on();
   bool pushed(); // will be refreshed by poll()
@@ -26,6 +27,12 @@ public:
   bool longPress(); // will be refreshed by poll()
   bool doubleClick(); // will be refreshed by poll()
   bool singleClick(); // will be refreshed by poll()
+  unsigned long onTime(); // ms since pushed, 0 if not on
+  void setAdaptiveDebounce(int minPeriod); // learn debouncePeriod between minPeriod and the constructor value, 0 = off
+  void setDebouncePeriod(int period); // e.g. restore a learned value, kept within the adaptive limits
+  int getDebouncePeriod();
+  int getBounceAverage(); // ms of bounce seen after a switch, running average
+  int getBouncePeak(); // ms of bounce seen after a switch, slowly decaying peak
  
   protected:
   bool process(); // not inline, used in child class
@@ -33,10 +40,12 @@ public:
   void inline debounce();
   void inline calcClick();
   void inline calcLongPress();
+  void inline adaptDebounce();
  
   unsigned long deglitchTime, switchedTime, pushedTime, ms;
   const byte pin;
-  const int deglitchPeriod, debouncePeriod, longPressPeriod, doubleClickPeriod;
+  const int deglitchPeriod, longPressPeriod, doubleClickPeriod, maxDebouncePeriod;
+  int debouncePeriod, minDebouncePeriod, lastBounce, bounceAverage8, bouncePeak;
   const bool polarity;
   bool input, lastInput, equal, deglitched, debounced, _switched, _longPress, longPressDisable, _doubleClick, _singleClick, singleClickStarted;
 };
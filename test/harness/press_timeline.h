@@ -0,0 +1,114 @@
+/*
+Timelines of button presses for the host tests.
+
+A timeline is a list of presses, each held then released for a number of ms.
+render() turns it into the input level for each millisecond, with contact bounce
+at each edge and sometimes a short glitch part way through, both worked out
+from the press's seed so a timeline always renders the same. A seed of 0 gives
+clean edges.
+
+Bounce and glitches are kept shorter than the Switch default deglitch period
+(10ms), so a press is always seen as one press.
+*/
+
+#ifndef PRESS_TIMELINE_H
+#define PRESS_TIMELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <Arduino.h>
+
+
+const static int MAX_BOUNCE = 8;          // Longest bounce at an edge (ms)
+const static int MAX_GLITCH = 8;          // Longest glitch (ms)
+const static int LEAD_IN = 300;           // Released before the first press (ms)
+
+
+// Small fast generator, so runs repeat from the seed
+
+struct xorshift
+{
+  uint32_t state;
+
+  uint32_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+  uint32_t range( uint32_t low, uint32_t high ) { return low + next() % ( high - low + 1 ); }
+};
+
+
+// A press - held for hold ms, then released for gap ms. Bounce and glitches come from seed, 0 for clean edges
+
+struct press
+{
+  unsigned hold;
+  unsigned gap;
+  uint32_t seed;
+};
+
+struct timeline
+{
+  unsigned long start;
+  std::vector<press> presses;
+};
+
+
+// Add ms at level, with bounce at the start and maybe a glitch part way
+
+inline void renderSegment( std::vector<uint8_t> &levels, uint8_t level, unsigned length, uint32_t seed )
+{
+  size_t from = levels.size();
+
+  levels.resize( from + length, level );
+
+  if( seed == 0 ) return;
+
+  xorshift rng = { seed };
+  unsigned bounce = rng.range( 0, MAX_BOUNCE );
+
+  for( unsigned i = 0; i < bounce; i++ ) levels[from + i] = rng.next() & 1;
+
+  if( rng.range( 0, 3 ) == 0 && length > bounce + 40 )
+  {
+    unsigned at = rng.range( bounce + 15, length - 25 );
+    unsigned glitch = rng.range( 1, MAX_GLITCH );
+
+    for( unsigned i = at; i < at + glitch; i++ ) levels[from + i] = !level;
+  }
+}
+
+// Millisecond by millisecond input for a timeline, and when each press starts
+
+inline void render( const timeline &t, std::vector<uint8_t> &levels, std::vector<unsigned> &pushAt )
+{
+  levels.clear();
+  pushAt.clear();
+
+  levels.resize( LEAD_IN, LOW );
+
+  for( const press &p : t.presses )
+  {
+    pushAt.push_back( levels.size() );
+    renderSegment( levels, HIGH, p.hold, p.seed );
+    renderSegment( levels, LOW, p.gap, p.seed * 2654435761u );
+  }
+}
+
+// Print a timeline, so a failing one can be replayed
+
+inline void printTimeline( const timeline &t )
+{
+  printf( "start %lu, presses (hold/gap/seed):", t.start );
+  for( const press &p : t.presses ) printf( " %u/%u/%08x", p.hold, p.gap, (unsigned)p.seed );
+  printf( "\n" );
+}
+
+
+#endif
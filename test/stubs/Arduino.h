@@ -0,0 +1,88 @@
+/*
+Host stand-in for the parts of the Arduino core used by the modules under test.
+
+Time is simulated - tests set hostMillis() and poll with it. Pin reads come from
+hostPins() and analogWrite() is recorded in hostPWM(), so tests can drive inputs
+and see outputs. random() repeats from randomSeed(). ESP has a simulated cycle
+count and RTC user memory, which counts writes and keeps its contents over a
+restart().
+*/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+const static int HOST_PINS = 32;
+
+inline unsigned long &hostMillis() { static unsigned long ms = 0; return ms; }
+inline int *hostPins() { static int pins[HOST_PINS]; return pins; }
+inline int *hostPWM() { static int pwm[HOST_PINS]; return pwm; }
+
+inline unsigned long millis() { return hostMillis(); }
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t pin) { return hostPins()[pin]; }
+inline void digitalWrite(uint8_t pin, uint8_t val) { hostPins()[pin] = val; }
+inline void analogWrite(uint8_t pin, int val) { hostPWM()[pin] = val; }
+
+inline uint32_t &hostRandom() { static uint32_t state = 0x12345678; return state; }
+inline void randomSeed(unsigned long seed) { hostRandom() = seed ? seed : 1; }
+inline long random(long howbig)
+{
+  uint32_t &x = hostRandom();
+  x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+  return howbig > 0 ? x % howbig : 0;
+}
+
+struct rst_info { uint32_t reason; };
+
+class EspClass
+{
+public:
+  uint32_t cycles = 0;                    // Cycle count - tests move it on
+  uint32_t rtc[128];                      // RTC user memory, in 4 byte blocks
+  int rtcWrites = 0;
+  int restarts = 0;
+  rst_info resetInfo = { 0 };
+
+  uint32_t getCycleCount() { return cycles; }
+  uint8_t getCpuFreqMHz() { return 80; }
+  rst_info *getResetInfoPtr() { return &resetInfo; }
+  void restart() { restarts++; }
+
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+  {
+    if( offset * 4 + size > sizeof(rtc) ) return false;
+    memcpy( data, (uint8_t *)rtc + offset * 4, size );
+    return true;
+  }
+
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+  {
+    if( offset * 4 + size > sizeof(rtc) ) return false;
+    memcpy( (uint8_t *)rtc + offset * 4, data, size );
+    rtcWrites++;
+    return true;
+  }
+};
+
+static EspClass ESP;
+
+#endif
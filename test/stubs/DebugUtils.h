@@ -0,0 +1,11 @@
+/*
+Host stand-in for DebugUtils - no debug output in tests.
+*/
+
+#ifndef DEBUGUTILS_H
+#define DEBUGUTILS_H
+
+#define DEBUG_PRINT(str)
+#define DEBUG_PRINTLN(str)
+
+#endif
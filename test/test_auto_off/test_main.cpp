@@ -0,0 +1,158 @@
+/*
+Host tests for autoOffControl.
+
+The minute timer is called directly, and the output's autoDim() stepped as the
+LED timer does on the device:
+
+  - with no activity, the output fades all the way off once the minutes are up
+  - activity during the fade stops it, leaving the output on at the level it had
+    got to, with its dim direction put back
+  - a scene recalled during the fade (restart() first, as main does) fades to
+    the scene rather than being stopped
+  - activity before the minutes are up starts the count again
+
+Run with: pio test -e native
+
+*/
+
+#include <unity.h>
+
+#include "../../src/PWM_LED_control.cpp"
+#include "../../src/auto_off.cpp"
+
+
+const static uint8_t OUTPUT_PIN = 2;
+const static int MINUTES = 3;
+
+
+// Output on at level, dimming up when next held
+
+void startOn( pwmLED &led, int level )
+{
+  pwmLEDScene scene = { true, level, 1, true, false, false };
+  led.setScene( scene );
+}
+
+// Minutes go by without activity
+
+void minutes( autoOffControl &autoOff, int count )
+{
+  for( int i = 0; i < count; i++ )
+  {
+    autoOff.tick();
+    autoOff.process();
+  }
+}
+
+void steps( pwmLED &led, autoOffControl &autoOff, int count )
+{
+  for( int i = 0; i < count; i++ )
+  {
+    led.autoDim();
+    autoOff.process();
+  }
+}
+
+void test_fades_off()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  autoOffControl autoOff( led );
+
+  startOn( led, 50 );
+  autoOff.setMinutes( MINUTES );
+  autoOff.restart();
+
+  minutes( autoOff, MINUTES - 1 );
+  TEST_ASSERT_FALSE( autoOff.isFading() );
+
+  minutes( autoOff, 1 );
+  TEST_ASSERT_TRUE( autoOff.isFading() );
+
+  steps( led, autoOff, 60 );
+
+  TEST_ASSERT_FALSE( led.getState() );
+  TEST_ASSERT_FALSE( autoOff.isFading() );
+  TEST_ASSERT_EQUAL( 0, hostPWM()[OUTPUT_PIN] );
+}
+
+void test_activity_stops_fade()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  autoOffControl autoOff( led );
+
+  startOn( led, 50 );
+  autoOff.setMinutes( MINUTES );
+  autoOff.restart();
+
+  minutes( autoOff, MINUTES );
+  steps( led, autoOff, 20 );                                // Part way down
+
+  TEST_ASSERT_EQUAL( 30, led.getLevel() );
+
+  autoOff.restart();                                        // e.g. the dimmer moved, or the button pressed
+  steps( led, autoOff, 100 );
+
+  pwmLEDScene end = led.getScene();
+
+  TEST_ASSERT_TRUE( end.state );
+  TEST_ASSERT_EQUAL( 30, end.level );
+  TEST_ASSERT_FALSE( end.dimLED );
+  TEST_ASSERT_TRUE( end.dimUp );
+  TEST_ASSERT_FALSE( autoOff.isFading() );
+  TEST_ASSERT_TRUE( hostPWM()[OUTPUT_PIN] > 0 );
+}
+
+void test_scene_during_fade()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  autoOffControl autoOff( led );
+  pwmLEDScene scene = { true, 80, 5, true, false, false };
+
+  startOn( led, 50 );
+  autoOff.setMinutes( MINUTES );
+  autoOff.restart();
+
+  minutes( autoOff, MINUTES );
+  steps( led, autoOff, 10 );
+
+  autoOff.restart();
+  led.fadeToScene( scene );
+  steps( led, autoOff, 100 );
+
+  TEST_ASSERT_TRUE( led.getState() );
+  TEST_ASSERT_EQUAL( 80, led.getLevel() );
+}
+
+void test_activity_restarts_count()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  autoOffControl autoOff( led );
+
+  startOn( led, 50 );
+  autoOff.setMinutes( MINUTES );
+  autoOff.restart();
+
+  minutes( autoOff, MINUTES - 1 );
+  autoOff.restart();
+  minutes( autoOff, MINUTES - 1 );
+
+  TEST_ASSERT_FALSE( autoOff.isFading() );
+
+  minutes( autoOff, 1 );
+
+  TEST_ASSERT_TRUE( autoOff.isFading() );
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_fades_off );
+  RUN_TEST( test_activity_stops_fade );
+  RUN_TEST( test_scene_during_fade );
+  RUN_TEST( test_activity_restarts_count );
+  return UNITY_END();
+}
@@ -0,0 +1,337 @@
+/*
+Host tests for clickActions.
+
+Timelines of presses, with contact bounce, are replayed a millisecond at a time
+through Switch::poll(input, ms) and clickActions::process(), with the output's
+autoDim() called every LED_UPDATE_RATE ms as the timer does on the device. The
+same timeline is run with and without speculative single click, and the two are
+compared:
+
+  - press to light - how long from the press until the output first gives light,
+    when it was off. The gain is printed
+  - a short tap, let go before it counts as a single click, ends the same as
+    without speculation, off and dark
+  - a double click, where the first half has already started dimming up, ends
+    the same as without speculation
+  - a confirmed hold (single click) is kept, and ends brighter than without
+    speculation as it started dimming sooner
+
+Hold to dim is run with and without acceleration:
+
+  - time to reach 25%, 50% and full from on at 0 is printed, and full comes in
+    well under half the time
+  - holds shorter than the fast rate delay end the same either way
+
+Run with: pio test -e native
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+
+#include "../../src/switch_v2.cpp"
+#include "../../src/PWM_LED_control.cpp"
+#include "../../src/click_actions.cpp"
+#include "press_timeline.h"
+
+
+// Settings as on the device
+
+const static int DEBOUNCE = 50;
+const static int LONG_PRESS = 10000;
+const static int DOUBLE_CLICK = 250;
+const static int DEGLITCH = 10;
+const static int LED_UPDATE_RATE = 20;
+const static int LED_DIM_NORMAL = 1;
+const static int LED_DIM_FAST = 5;
+const static int LED_DIM_VERYFAST = 10;
+const static dimAccel DIM_ACCEL = { 500, 1000 };
+
+const static int TOLERANCE = 25;          // Keep clear of the double click period either side (ms)
+const static int RUNS = 2000;             // Timelines per test
+
+const static uint8_t INPUT_PIN = 1;
+const static uint8_t OUTPUT_PIN = 2;
+
+
+// How a timeline went
+
+struct result
+{
+  pwmLEDScene end;                        // Output at the end
+  long toLight;                           // ms from the first press until the output first gave light, -1 if never
+  long lit;                               // ms the output gave light for
+  long toLevel[101];                      // ms from the first press until each level was reached or passed while on, -1 if never
+};
+
+// Replay a timeline from the output as start
+
+result simulate( const timeline &t, bool speculative, const pwmLEDScene &start, const dimAccel &accel = DIM_ACCEL )
+{
+  std::vector<uint8_t> levels;
+  std::vector<unsigned> pushAt;
+
+  render( t, levels, pushAt );
+
+  hostMillis() = t.start;
+  hostPins()[INPUT_PIN] = LOW;
+
+  Switch button( INPUT_PIN, INPUT, HIGH, DEBOUNCE, LONG_PRESS, DOUBLE_CLICK, DEGLITCH );
+  pwmLED led( OUTPUT_PIN, false, 100, LED_DIM_NORMAL, false, false );
+  clickActions actions( button, led, LED_DIM_NORMAL, LED_DIM_FAST, LED_DIM_VERYFAST );
+
+  actions.setSpeculative( speculative );
+  actions.setAcceleration( accel );
+  led.setScene( start );
+
+  result r = { start, -1, 0, {} };
+
+  for( long &ms : r.toLevel ) ms = -1;
+
+  for( size_t i = 0; i < levels.size(); i++ )
+  {
+    hostMillis() = t.start + i;
+
+    button.poll( levels[i], hostMillis() );
+    actions.process();
+
+    if( ( t.start + i ) % LED_UPDATE_RATE == 0 ) led.autoDim();     // Timer runs on its own, not from the press
+
+    if( hostPWM()[OUTPUT_PIN] > 0 )
+    {
+      if( r.toLight < 0 ) r.toLight = i - pushAt[0];
+      r.lit++;
+    }
+
+    for( int level = led.getState() ? led.getLevel() : -1; level >= 0 && r.toLevel[level] < 0; level-- ) r.toLevel[level] = i - pushAt[0];
+  }
+
+  r.end = led.getScene();
+
+  return r;
+}
+
+bool sameScene( const pwmLEDScene &a, const pwmLEDScene &b )
+{
+  return a.state == b.state && a.level == b.level && a.dimRate == b.dimRate && a.dimUp == b.dimUp && a.dimLED == b.dimLED && a.isCyclic == b.isCyclic;
+}
+
+void printScene( const char *name, const pwmLEDScene &s )
+{
+  printf( "%s: state %d, level %d, rate %d, up %d, dimming %d\n", name, s.state, s.level, s.dimRate, s.dimUp, s.dimLED );
+}
+
+// Off, at a random level and direction
+
+pwmLEDScene offScene( xorshift &rng )
+{
+  pwmLEDScene scene = { false, (int)rng.range( 20, 90 ), LED_DIM_NORMAL, rng.range( 0, 1 ) == 1, false, false };
+  return scene;
+}
+
+// A press from a random time, some just before millis() wraps
+
+timeline pressTimeline( xorshift &rng, unsigned holdMin, unsigned holdMax )
+{
+  timeline t;
+
+  t.start = rng.range( 0, 1 ) ? 0UL - rng.range( 0, 2000 ) : rng.next();
+  t.presses.push_back( press{ rng.range( holdMin, holdMax ), 600, rng.next() | 1 } );
+
+  return t;
+}
+
+
+// Press to light, from off, for holds that become a single click
+
+void test_latency()
+{
+  xorshift rng = { 0x5EED0035 };
+  long sum[2] = { 0, 0 }, worst[2] = { 0, 0 };
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, DOUBLE_CLICK + TOLERANCE, 2000 );
+    pwmLEDScene start = offScene( rng );
+
+    for( int speculative = 0; speculative < 2; speculative++ )
+    {
+      result r = simulate( t, speculative, start );
+
+      TEST_ASSERT_TRUE_MESSAGE( r.toLight >= 0, "never lit" );
+
+      sum[speculative] += r.toLight;
+      if( r.toLight > worst[speculative] ) worst[speculative] = r.toLight;
+    }
+  }
+
+  printf( "Press to light: on single click avg %ldms (worst %ldms), speculative avg %ldms (worst %ldms) - %ldms sooner\n",
+    sum[0] / RUNS, worst[0], sum[1] / RUNS, worst[1], ( sum[0] - sum[1] ) / RUNS );
+
+  TEST_ASSERT_LESS_THAN( DEBOUNCE, worst[1] );
+  TEST_ASSERT_GREATER_THAN( DOUBLE_CLICK, sum[0] / RUNS );
+}
+
+// Short tap - let go before it counts as a single click, so it is put back
+
+void test_short_tap_rolled_back()
+{
+  xorshift rng = { 0x5EED1035 };
+  long lit = 0;
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, 70, DOUBLE_CLICK - TOLERANCE );
+    pwmLEDScene start = offScene( rng );
+
+    result plain = simulate( t, false, start );
+    result speculated = simulate( t, true, start );
+
+    if( !sameScene( plain.end, speculated.end ) )
+    {
+      printTimeline( t );
+      printScene( "on single click", plain.end );
+      printScene( "speculative", speculated.end );
+      TEST_FAIL_MESSAGE( "short tap not put back - see above" );
+    }
+
+    TEST_ASSERT_FALSE( speculated.end.state );
+    TEST_ASSERT_EQUAL( start.level, speculated.end.level );
+    TEST_ASSERT_EQUAL( 0, hostPWM()[OUTPUT_PIN] );
+
+    lit += speculated.lit;
+  }
+
+  printf( "Short tap: put back every time, lit for avg %ldms before it was\n", lit / RUNS );
+}
+
+// Double click - the first half has started dimming up, and is put back before the toggle. The second
+// press is short enough not to dim back to off
+
+void test_double_click_rolled_back()
+{
+  xorshift rng = { 0x5EED2035 };
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, 70, 120 );
+    unsigned gap = rng.range( 70, DOUBLE_CLICK - TOLERANCE - t.presses[0].hold );
+
+    t.presses[0].gap = gap;
+    t.presses.push_back( press{ rng.range( 70, 200 ), 600, rng.next() | 1 } );
+
+    pwmLEDScene start = offScene( rng );
+
+    result plain = simulate( t, false, start );
+    result speculated = simulate( t, true, start );
+
+    if( !sameScene( plain.end, speculated.end ) )
+    {
+      printTimeline( t );
+      printScene( "on single click", plain.end );
+      printScene( "speculative", speculated.end );
+      TEST_FAIL_MESSAGE( "double click differs - see above" );
+    }
+
+    TEST_ASSERT_TRUE( speculated.end.state );
+  }
+}
+
+// Confirmed hold - kept, and brighter as it started sooner. Holds stay under the fast rate and the top
+
+void test_confirmed_hold_kept()
+{
+  xorshift rng = { 0x5EED3035 };
+  long gained = 0;
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, DOUBLE_CLICK + TOLERANCE, DIM_ACCEL.fastAfter - TOLERANCE );
+    pwmLEDScene start = offScene( rng );
+
+    result plain = simulate( t, false, start );
+    result speculated = simulate( t, true, start );
+
+    TEST_ASSERT_TRUE( plain.end.state );
+    TEST_ASSERT_TRUE( speculated.end.state );
+    TEST_ASSERT_EQUAL( plain.end.dimUp, speculated.end.dimUp );
+    TEST_ASSERT_GREATER_THAN( plain.end.level, speculated.end.level );
+
+    gained += speculated.end.level - plain.end.level;
+  }
+
+  printf( "Confirmed hold: kept every time, avg %ld levels brighter when let go\n", gained / RUNS );
+}
+
+
+// Hold to dim from on at 0 - time to reach each target, with and without acceleration
+
+void test_time_to_target()
+{
+  const static int TARGETS[] = { 25, 50, 100 };
+  const static dimAccel NO_ACCEL = { 0, 0 };
+
+  xorshift rng = { 0x5EED0037 };
+  pwmLEDScene start = { true, 0, LED_DIM_NORMAL, true, false, false };
+  long sum[2][3] = { { 0 } };
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, 2500, 2600 );
+
+    result plain = simulate( t, false, start, NO_ACCEL );
+    result accelerated = simulate( t, false, start );
+
+    for( int i = 0; i < 3; i++ )
+    {
+      TEST_ASSERT_TRUE_MESSAGE( accelerated.toLevel[TARGETS[i]] >= 0, "target not reached" );
+
+      sum[0][i] += plain.toLevel[TARGETS[i]] >= 0 ? plain.toLevel[TARGETS[i]] : t.presses[0].hold;
+      sum[1][i] += accelerated.toLevel[TARGETS[i]];
+    }
+  }
+
+  for( int i = 0; i < 3; i++ )
+  {
+    printf( "Hold to %d%%: normal rate avg %ldms, accelerated avg %ldms\n", TARGETS[i], sum[0][i] / RUNS, sum[1][i] / RUNS );
+  }
+
+  TEST_ASSERT_LESS_THAN( sum[0][2] / 2, sum[1][2] );           // Full in well under half the time
+}
+
+// Short holds are fine adjustment - the same change with and without acceleration
+
+void test_short_hold_unchanged()
+{
+  const static dimAccel NO_ACCEL = { 0, 0 };
+
+  xorshift rng = { 0x5EED1037 };
+  pwmLEDScene start = { true, 0, LED_DIM_NORMAL, true, false, false };
+
+  for( int n = 0; n < RUNS; n++ )
+  {
+    timeline t = pressTimeline( rng, 70, DIM_ACCEL.fastAfter - TOLERANCE );
+    start.level = rng.range( 0, 60 );
+
+    result plain = simulate( t, false, start, NO_ACCEL );
+    result accelerated = simulate( t, false, start );
+
+    TEST_ASSERT_TRUE( sameScene( plain.end, accelerated.end ) );
+  }
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_latency );
+  RUN_TEST( test_short_tap_rolled_back );
+  RUN_TEST( test_double_click_rolled_back );
+  RUN_TEST( test_confirmed_hold_kept );
+  RUN_TEST( test_time_to_target );
+  RUN_TEST( test_short_hold_unchanged );
+  return UNITY_END();
+}
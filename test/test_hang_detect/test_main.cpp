@@ -0,0 +1,224 @@
+/*
+Host tests for hangDetector.
+
+The ESP's cycle count and RTC user memory are simulated (test/stubs/Arduino.h).
+A run of loop() stages is stepped with check() called every HANG_CHECK_RATE ms
+as the timer does on the device:
+
+  - stage() writes nothing to RTC memory - only check() does, once a tick
+  - times land in the right histogram bucket, and the max is kept
+  - after a restart the breadcrumbs and max times are as of the last check
+  - a stage over budget is restarted in, with the callback called first, and
+    the stage and time it had been running are kept over the restart
+
+The cost of stage() is timed. Host times are only a relative measure.
+
+Run with: pio test -e native
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "../../src/hang_detect.cpp"
+
+
+// Settings as on the device
+
+const static unsigned long HANG_CHECK_RATE = 1000;
+const static uint32_t CYCLES_PER_MS = 80000;        // 80MHz
+
+enum { STAGE_BUTTON, STAGE_LED, STAGE_BLYNK, STAGE_COUNT };
+
+const static unsigned long BUDGETS[STAGE_COUNT] = { 2000, 2000, 5000 };
+
+
+// Spend ms in the current stage
+
+void spend( unsigned long ms )
+{
+  ESP.cycles += ms * CYCLES_PER_MS;
+}
+
+// A fresh power on
+
+void powerOn()
+{
+  memset( ESP.rtc, 0, sizeof(ESP.rtc) );
+  ESP.rtcWrites = 0;
+  ESP.restarts = 0;
+  ESP.cycles = 0;
+}
+
+
+// Loop stages write no RTC memory, the check tick writes it once
+
+void test_stage_writes_no_rtc()
+{
+  hangDetector hangs( BUDGETS, STAGE_COUNT );
+
+  powerOn();
+  hangs.begin();
+
+  int writes = ESP.rtcWrites;
+
+  for( int i = 0; i < 1000; i++ )
+  {
+    hangs.stage( STAGE_BUTTON );
+    hangs.stage( STAGE_LED );
+    hangs.stage( STAGE_BLYNK );
+  }
+
+  TEST_ASSERT_EQUAL( writes, ESP.rtcWrites );
+
+  hangs.check( HANG_CHECK_RATE );
+
+  TEST_ASSERT_EQUAL( writes + 1, ESP.rtcWrites );
+}
+
+// Histogram buckets and max time
+
+void test_histogram_and_max()
+{
+  hangDetector hangs( BUDGETS, STAGE_COUNT );
+
+  powerOn();
+  hangs.begin();
+
+  const static unsigned long TIMES[] = { 0, 1, 3, 4, 7, 64, 200 };
+  const static int BUCKETS[] = { 0, 1, 2, 3, 3, 7, 7 };
+
+  for( unsigned long ms : TIMES )
+  {
+    hangs.stage( STAGE_BLYNK );
+    spend( ms );
+    hangs.stage( STAGE_BUTTON );
+  }
+
+  const unsigned long *histogram = hangs.getHistogram( STAGE_BLYNK );
+  unsigned long expected[hangDetector::HISTOGRAM_BUCKETS] = { 0 };
+
+  for( int bucket : BUCKETS ) expected[bucket]++;
+  for( int i = 0; i < hangDetector::HISTOGRAM_BUCKETS; i++ ) TEST_ASSERT_EQUAL( expected[i], histogram[i] );
+
+  unsigned long max = hangs.getMaxTime( STAGE_BLYNK );
+
+  TEST_ASSERT_EQUAL( 200, max );
+}
+
+// Restarted by the hardware watchdog - the last check's breadcrumbs and max times are there
+
+void test_breadcrumbs_over_reset()
+{
+  hangDetector hangs( BUDGETS, STAGE_COUNT );
+
+  powerOn();
+  hangs.begin();
+
+  hangs.stage( STAGE_BUTTON );
+  hangs.stage( STAGE_LED );
+  spend( 30 );
+  hangs.stage( STAGE_BLYNK );
+  hangs.check( HANG_CHECK_RATE );
+
+  hangs.stage( STAGE_BUTTON );                      // After the last check - not seen
+  spend( 100 );
+
+  hangDetector after( BUDGETS, STAGE_COUNT );
+  after.begin();
+
+  TEST_ASSERT_EQUAL( STAGE_BLYNK, after.getLastStage( 0 ) );
+  TEST_ASSERT_EQUAL( STAGE_LED, after.getLastStage( 1 ) );
+  TEST_ASSERT_EQUAL( STAGE_BUTTON, after.getLastStage( 2 ) );
+  TEST_ASSERT_EQUAL( hangDetector::NO_STAGE, after.getTrippedStage() );
+
+  unsigned long max = after.getLastMaxTime( STAGE_LED );
+
+  TEST_ASSERT_EQUAL( 30, max );
+}
+
+// Over budget - restarted in, after the callback, and kept over the restart
+
+static int callbacks;
+static int writesAtCallback;
+
+void onRestart()
+{
+  callbacks++;
+  writesAtCallback = ESP.rtcWrites;
+}
+
+void test_trip()
+{
+  hangDetector hangs( BUDGETS, STAGE_COUNT );
+
+  powerOn();
+  hangs.begin();
+  hangs.setRestartCallback( onRestart );
+  callbacks = 0;
+
+  hangs.stage( STAGE_BUTTON );
+  hangs.stage( STAGE_BLYNK );
+
+  unsigned long ms = 0;
+
+  while( ESP.restarts == 0 && ms < 10 * BUDGETS[STAGE_BLYNK] )
+  {
+    spend( HANG_CHECK_RATE );
+    ms += HANG_CHECK_RATE;
+    hangs.check( HANG_CHECK_RATE );
+  }
+
+  TEST_ASSERT_EQUAL( 1, ESP.restarts );
+  TEST_ASSERT_EQUAL( 1, callbacks );
+  TEST_ASSERT_EQUAL( ESP.rtcWrites, writesAtCallback );        // Breadcrumbs written before the callback
+
+  hangDetector after( BUDGETS, STAGE_COUNT );
+  after.begin();
+
+  unsigned long max = after.getLastMaxTime( STAGE_BLYNK );
+
+  TEST_ASSERT_EQUAL( STAGE_BLYNK, after.getTrippedStage() );
+  TEST_ASSERT_EQUAL( STAGE_BLYNK, after.getLastStage( 0 ) );
+  TEST_ASSERT_GREATER_THAN( BUDGETS[STAGE_BLYNK], max );
+}
+
+// Time per stage()
+
+void test_stage_benchmark()
+{
+  const static int STAGES = 10000000;
+
+  hangDetector hangs( BUDGETS, STAGE_COUNT );
+
+  powerOn();
+  hangs.begin();
+
+  auto began = std::chrono::steady_clock::now();
+
+  for( int i = 0; i < STAGES; i++ )
+  {
+    ESP.cycles += 997;
+    hangs.stage( i % STAGE_COUNT );
+  }
+
+  double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - began ).count() / STAGES;
+
+  printf( "stage(): %.1fns each, %d RTC writes\n", ns, ESP.rtcWrites );
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_stage_writes_no_rtc );
+  RUN_TEST( test_histogram_and_max );
+  RUN_TEST( test_breadcrumbs_over_reset );
+  RUN_TEST( test_trip );
+  RUN_TEST( test_stage_benchmark );
+  return UNITY_END();
+}
@@ -0,0 +1,214 @@
+/*
+Host tests for pwmLED scenes.
+
+fadeToScene() is stepped with autoDim() as the timer does on the device:
+
+  - from off, an on scene fades up from 0 at the scene's rate and stops on its
+    level, with the scene's direction and dimming
+  - from on, an off scene fades down to 0 and goes off, keeping the scene's
+    level for when it is turned on again
+  - changing the level part way through stops the fade where it is
+  - setScene() is still a single change
+
+pwmLEDGroup is checked to refuse outputs past its limit and to step every output
+it holds, and its per tick cost is timed for 1, 4 and 16 outputs, all dimming and
+all idle. Host times are only a relative measure - the ESP8266 is far slower.
+
+Run with: pio test -e native
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "../../src/PWM_LED_control.cpp"
+
+
+const static uint8_t OUTPUT_PIN = 2;
+
+
+// Step until the output stops changing, or steps run out - returns the steps taken
+
+int fade( pwmLED &led, int steps )
+{
+  for( int i = 0; i < steps; i++ )
+  {
+    pwmLEDScene before = led.getScene();
+
+    led.autoDim();
+
+    pwmLEDScene after = led.getScene();
+    if( after.level == before.level && after.state == before.state && !after.dimLED ) return i;
+  }
+
+  return steps;
+}
+
+void test_fade_up_from_off()
+{
+  pwmLED led( OUTPUT_PIN, false, 30, 1, true, false );
+  pwmLEDScene scene = { true, 60, 5, false, false, false };
+  int lastPWM = 0;
+
+  led.fadeToScene( scene );
+
+  TEST_ASSERT_EQUAL( 0, hostPWM()[OUTPUT_PIN] );            // Starts from dark, not the old level
+
+  for( int i = 0; i < 12; i++ )
+  {
+    led.autoDim();
+    TEST_ASSERT_TRUE( hostPWM()[OUTPUT_PIN] >= lastPWM );
+    lastPWM = hostPWM()[OUTPUT_PIN];
+  }
+
+  TEST_ASSERT_EQUAL( 60, led.getLevel() );                  // 12 steps of 5, stopped on the level
+  led.autoDim();
+  TEST_ASSERT_EQUAL( 60, led.getLevel() );
+
+  pwmLEDScene end = led.getScene();
+
+  TEST_ASSERT_TRUE( end.state );
+  TEST_ASSERT_EQUAL( 5, end.dimRate );
+  TEST_ASSERT_FALSE( end.dimUp );
+  TEST_ASSERT_FALSE( end.dimLED );
+}
+
+void test_fade_down_to_off()
+{
+  pwmLED led( OUTPUT_PIN, true, 80, 1, true, false );
+  pwmLEDScene scene = { false, 40, 10, true, false, false };
+
+  led.fadeToScene( scene );
+
+  int steps = fade( led, 20 );
+
+  TEST_ASSERT_EQUAL( 8, steps );                            // 80 to 0 in steps of 10
+
+  TEST_ASSERT_FALSE( led.getState() );
+  TEST_ASSERT_EQUAL( 40, led.getLevel() );
+  TEST_ASSERT_EQUAL( 0, hostPWM()[OUTPUT_PIN] );
+}
+
+void test_fade_stopped_by_change()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  pwmLEDScene scene = { true, 100, 2, true, false, false };
+
+  led.fadeToScene( scene );
+  for( int i = 0; i < 10; i++ ) led.autoDim();
+
+  led.setLevel( 25 );
+  for( int i = 0; i < 10; i++ ) led.autoDim();
+
+  TEST_ASSERT_EQUAL( 25, led.getLevel() );
+}
+
+void test_set_scene_immediate()
+{
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+  pwmLEDScene scene = { true, 70, 3, true, false, false };
+
+  led.setScene( scene );
+
+  TEST_ASSERT_EQUAL( 70, led.getLevel() );
+  TEST_ASSERT_TRUE( hostPWM()[OUTPUT_PIN] > 0 );
+}
+
+
+// Group - the 17th output is refused
+
+void test_group_full()
+{
+  pwmLEDGroup group;
+  pwmLED led( OUTPUT_PIN, false, 0, 1, true, false );
+
+  for( int i = 0; i < 16; i++ ) TEST_ASSERT_TRUE( group.add( &led ) );
+
+  TEST_ASSERT_FALSE( group.add( &led ) );
+}
+
+// Group - every output dimming is stepped, at its own rate and direction. Idle ones are left alone
+
+void test_group_steps_all()
+{
+  pwmLEDGroup group;
+  pwmLED up( 3, true, 10, 2, true, false );
+  pwmLED down( 4, true, 50, 5, false, false );
+  pwmLED idle( 5, true, 40, 1, true, false );
+  pwmLED off( 6, false, 40, 1, true, false );
+
+  up.dimLED( true );
+  down.dimLED( true );
+  off.dimLED( true );
+
+  group.add( &up );
+  group.add( &down );
+  group.add( &idle );
+  group.add( &off );
+
+  for( int i = 0; i < 4; i++ ) group.autoDim();
+
+  TEST_ASSERT_EQUAL( 18, up.getLevel() );
+  TEST_ASSERT_EQUAL( 30, down.getLevel() );
+  TEST_ASSERT_EQUAL( 40, idle.getLevel() );
+  TEST_ASSERT_EQUAL( 40, off.getLevel() );
+  TEST_ASSERT_EQUAL( 0, hostPWM()[6] );
+}
+
+// Group - time per tick
+
+double nsPerTick( int outputs, bool dimming )
+{
+  const static int TICKS = 1000000;
+
+  pwmLEDGroup group;
+  pwmLED *leds[16];
+
+  for( int i = 0; i < outputs; i++ )
+  {
+    leds[i] = new pwmLED( i, true, 50, 1, true, true );        // Cyclic, so it keeps dimming
+    leds[i]->dimLED( dimming );
+    group.add( leds[i] );
+  }
+
+  auto began = std::chrono::steady_clock::now();
+
+  for( int i = 0; i < TICKS; i++ ) group.autoDim();
+
+  double ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - began ).count() / TICKS;
+
+  for( int i = 0; i < outputs; i++ ) delete leds[i];
+
+  return ns;
+}
+
+void test_group_benchmark()
+{
+  const static int OUTPUTS[] = { 1, 4, 16 };
+
+  for( int outputs : OUTPUTS )
+  {
+    double dimming = nsPerTick( outputs, true );
+    double idle = nsPerTick( outputs, false );
+
+    printf( "Group of %2d: %6.1fns per tick all dimming (%5.1fns each), %5.1fns all idle\n", outputs, dimming, dimming / outputs, idle );
+  }
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_fade_up_from_off );
+  RUN_TEST( test_fade_down_to_off );
+  RUN_TEST( test_fade_stopped_by_change );
+  RUN_TEST( test_set_scene_immediate );
+  RUN_TEST( test_group_full );
+  RUN_TEST( test_group_steps_all );
+  RUN_TEST( test_group_benchmark );
+  return UNITY_END();
+}
@@ -0,0 +1,218 @@
+/*
+Host fleet simulation of reconnecting to the Blynk server.
+
+Thousands of virtual units each run the real reconnectHoldOff (what
+blynkRunDue() uses) under simulated time, against a stand-in for the server and
+the site router:
+
+  - each unit's loop runs every LOOP_TIME ms, at its own phase
+  - when the hold off says so, a unit that is not connected tries to log in. As
+    the Blynk library does, it tries at most once every LOGIN_RETRY ms
+  - the server accepts at most SERVER_CAPACITY logins in each 100ms slot, and
+    rejects the rest. Nothing gets through while the router is down
+  - when the router goes down, each unit notices a random time up to
+    NOTICE_TIME later, as its heartbeat times out
+
+Reconnect storms are run after a short and a long router outage, with the hold
+off as on the device and with none. Each run prints the peak logins tried in a
+slot, the logins rejected, and percentiles of the time from the router coming
+back until each unit is connected again. The storm with the hold off must
+reject fewer logins. Throughput is printed.
+
+A unit coming up for the first time is not held off.
+
+Run with: pio test -e native
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "../../src/reconnect_hold_off.cpp"
+
+
+// Settings as on the device
+
+const static unsigned long RECONNECT_JITTER = 10000;
+
+// Stand-in for the site and server
+
+const static int UNITS = 2000;
+const static int LOOP_TIME = 10;                  // ms between loops
+const static int LOGIN_RETRY = 5000;              // Blynk library login retry (ms)
+const static int NOTICE_TIME = 2000;              // Longest to notice the server has gone (ms)
+const static int SLOT = 100;                      // Server capacity slot (ms)
+const static int SERVER_CAPACITY = 20;            // Logins accepted per slot
+const static unsigned long ROUTER_DOWN_AT = 1000; // When the router goes down (ms)
+const static unsigned long RUN_TIME = 180000;     // Length of each run (ms)
+
+
+struct unit
+{
+  reconnectHoldOff holdOff;
+  bool connected;
+  unsigned long noticeAt;                         // When it notices the router went down
+  unsigned long lastLogin;                        // Last login tried
+  bool tried;                                     // Tried a login since losing the server
+  long reconnected;                               // ms after the router came back, -1 if not yet
+};
+
+struct storm
+{
+  int peak;                                       // Most logins tried in one slot after the router came back
+  long rejected;                                  // Logins the server turned away
+  long tries;                                     // Logins tried
+  std::vector<long> times;                        // ms after the router came back until each unit reconnected
+  unsigned long long steps;                       // Unit loops run
+};
+
+// Run a router outage across the site
+
+storm simulate( unsigned long outage, unsigned long jitter, uint32_t seed )
+{
+  std::vector<unit> units;
+  std::vector<int> slotTries( RUN_TIME / SLOT + 1, 0 ), slotLogins( RUN_TIME / SLOT + 1, 0 );
+  storm result = { 0, 0, 0, {}, 0 };
+  unsigned long routerUpAt = ROUTER_DOWN_AT + outage;
+
+  randomSeed( seed );
+
+  for( int i = 0; i < UNITS; i++ )
+  {
+    units.push_back( unit{ reconnectHoldOff( jitter ), true, ROUTER_DOWN_AT + random( NOTICE_TIME ), 0, false, -1 } );
+    hostMillis() = 0;
+    units.back().holdOff.due( true );             // Up and connected before the outage
+  }
+
+  std::vector<int> phase( UNITS );
+  for( int i = 0; i < UNITS; i++ ) phase[i] = random( LOOP_TIME );
+
+  for( unsigned long ms = 0; ms < RUN_TIME; ms++ )
+  {
+    bool routerUp = ms < ROUTER_DOWN_AT || ms >= routerUpAt;
+    int slot = ms / SLOT;
+
+    for( int i = 0; i < UNITS; i++ )
+    {
+      if( ( ms + phase[i] ) % LOOP_TIME ) continue;
+
+      unit &u = units[i];
+
+      hostMillis() = ms;
+      result.steps++;
+
+      if( u.connected && u.reconnected < 0 && ms >= u.noticeAt )     // Heartbeat timed out - outages are longer than NOTICE_TIME
+      {
+        u.connected = false;
+        u.tried = false;
+      }
+
+      if( !u.holdOff.due( u.connected ) || u.connected ) continue;
+      if( u.tried && ms - u.lastLogin < (unsigned long)LOGIN_RETRY ) continue;
+
+      u.tried = true;
+      u.lastLogin = ms;
+      result.tries++;
+      if( routerUp ) slotTries[slot]++;
+
+      if( routerUp && slotLogins[slot] < SERVER_CAPACITY )
+      {
+        slotLogins[slot]++;
+        u.connected = true;
+        u.reconnected = ms - routerUpAt;
+      }
+      else if( routerUp ) result.rejected++;
+    }
+  }
+
+  for( int tries : slotTries ) result.peak = std::max( result.peak, tries );
+  for( const unit &u : units ) result.times.push_back( u.reconnected );
+
+  std::sort( result.times.begin(), result.times.end() );
+
+  return result;
+}
+
+long percentile( const std::vector<long> &times, int percent )
+{
+  return times[( times.size() - 1 ) * percent / 100];
+}
+
+void printStorm( const char *name, const storm &s )
+{
+  printf( "%s: peak %d logins/%dms, %ld tried, %ld rejected, reconnected after p50 %.1fs p90 %.1fs p99 %.1fs max %.1fs\n",
+    name, s.peak, SLOT, s.tries, s.rejected, percentile( s.times, 50 ) / 1000.0, percentile( s.times, 90 ) / 1000.0,
+    percentile( s.times, 99 ) / 1000.0, s.times.back() / 1000.0 );
+}
+
+// Run an outage with and without the hold off, and compare
+
+void outage( unsigned long length, uint32_t seed )
+{
+  auto began = std::chrono::steady_clock::now();
+
+  storm none = simulate( length, 0, seed );
+  storm held = simulate( length, RECONNECT_JITTER, seed );
+
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - began ).count();
+
+  printf( "Router down %lus, %d units:\n", length / 1000, UNITS );
+  printStorm( "  no hold off  ", none );
+  printStorm( "  with hold off", held );
+  printf( "  %.1fM unit loops in %.2fs - %.1fM loops/s\n", ( none.steps + held.steps ) / 1e6, seconds, ( none.steps + held.steps ) / seconds / 1e6 );
+
+  TEST_ASSERT_TRUE_MESSAGE( none.times.front() >= 0 && held.times.front() >= 0, "not every unit reconnected" );
+  TEST_ASSERT_LESS_THAN( none.rejected, held.rejected );
+  TEST_ASSERT_LESS_THAN( none.peak, held.peak );
+}
+
+void test_short_outage()
+{
+  outage( 3000, 0x5EED0031 );
+}
+
+void test_long_outage()
+{
+  outage( 30000, 0x5EED1031 );
+}
+
+// First connect after boot is not held off, later ones are
+
+void test_first_connect_not_held()
+{
+  reconnectHoldOff holdOff( RECONNECT_JITTER );
+
+  randomSeed( 1 );
+  hostMillis() = 0;
+
+  TEST_ASSERT_TRUE( holdOff.due( false ) );
+
+  holdOff.due( true );
+
+  int held = 0;
+
+  for( int i = 0; i < 100; i++ )                    // Lose it again and again - each is held off for a random time
+  {
+    hostMillis() += 60000;
+    holdOff.due( true );
+    held += !holdOff.due( false );
+  }
+
+  TEST_ASSERT_GREATER_THAN( 90, held );
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_first_connect_not_held );
+  RUN_TEST( test_short_outage );
+  RUN_TEST( test_long_outage );
+  return UNITY_END();
+}
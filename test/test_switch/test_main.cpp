@@ -0,0 +1,409 @@
+/*
+Host tests for Switch.
+
+Randomised timelines of presses, with contact bounce at each edge and short
+glitches while held or released, are replayed through Switch::poll(input, ms) a
+millisecond at a time. Each run is checked against invariants, and against a
+reference model worked out from the intended presses:
+
+  - every press gives exactly one push and one release
+  - a press never gives both a single click and a double click
+  - no more than one single click, double click or long press per press
+  - a double click when the push follows the last push by clearly less than
+    the double click period, and not when clearly more
+  - a single click when held clearly longer than the double click period and
+    not a double click, and not when held clearly shorter
+  - a long press when held clearly longer than the long press period, and not
+    when held clearly shorter
+
+"Clearly" is outside TOLERANCE either side of the threshold, as bounce moves
+when the edge is seen. About half the timelines start just before millis()
+wraps, and a run fails if too few of them actually cross it.
+
+Adaptive debounce is also checked directly: a learned period restored at boot
+survives the next switch, and the window grows back when bounce gets worse.
+
+A failing timeline is shrunk, by dropping presses and removing bounce, to the
+smallest that still fails, and printed. Throughput is printed for each run.
+
+Run with: pio test -e native
+Long run: FUZZ_TIMELINES=5000000 pio test -e native -f test_switch
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "../../src/switch_v2.cpp"
+#include "press_timeline.h"
+
+
+// Settings under test - long press is shortened so timelines reach it
+
+const static int DEBOUNCE = 50;
+const static int LONG_PRESS = 1000;
+const static int DOUBLE_CLICK = 250;
+const static int DEGLITCH = 10;
+const static int ADAPTIVE_MIN = 15;
+
+const static int TOLERANCE = 25;          // Reference model doesn't decide within this of a threshold (ms)
+const static int MIN_STEADY = 70;         // Shortest press or gap (ms)
+
+const static long TIMELINES = 20000;      // Timelines per run, unless FUZZ_TIMELINES is set
+const static int MAX_PRESSES = 20;        // Presses per timeline
+
+const static uint8_t PIN = 1;
+
+
+// What the switch reported for each press
+
+struct pressEvents
+{
+  int singles;
+  int doubles;
+  int longs;
+  bool released;
+};
+
+unsigned long polls = 0;
+
+// Replay a timeline and check it - returns what went wrong, empty if nothing
+
+std::string check( const timeline &t, bool adaptive )
+{
+  std::vector<uint8_t> levels;
+  std::vector<unsigned> pushAt;
+  std::vector<pressEvents> events;
+  char error[160];
+
+  render( t, levels, pushAt );
+
+  hostMillis() = t.start;
+  hostPins()[PIN] = LOW;
+
+  Switch button( PIN, INPUT, HIGH, DEBOUNCE, LONG_PRESS, DOUBLE_CLICK, DEGLITCH );
+  if( adaptive ) button.setAdaptiveDebounce( ADAPTIVE_MIN );
+
+  for( size_t i = 0; i < levels.size(); i++ )
+  {
+    button.poll( levels[i], t.start + i );
+    polls++;
+
+    if( button.pushed() )
+    {
+      if( !events.empty() && !events.back().released )
+      {
+        snprintf( error, sizeof(error), "push %u at %u ms without a release", (unsigned)events.size(), (unsigned)i );
+        return error;
+      }
+      events.push_back( pressEvents{ 0, 0, 0, false } );
+    }
+
+    if( events.empty() )
+    {
+      if( button.switched() || button.singleClick() || button.doubleClick() || button.longPress() )
+      {
+        snprintf( error, sizeof(error), "event before first push at %u ms", (unsigned)i );
+        return error;
+      }
+      continue;
+    }
+
+    pressEvents &e = events.back();
+
+    if( button.released() )
+    {
+      if( e.released )
+      {
+        snprintf( error, sizeof(error), "second release of press %u at %u ms", (unsigned)events.size() - 1, (unsigned)i );
+        return error;
+      }
+      e.released = true;
+    }
+
+    e.singles += button.singleClick();
+    e.doubles += button.doubleClick();
+    e.longs += button.longPress();
+  }
+
+  if( events.size() != t.presses.size() )
+  {
+    snprintf( error, sizeof(error), "%u presses gave %u pushes", (unsigned)t.presses.size(), (unsigned)events.size() );
+    return error;
+  }
+
+  for( size_t k = 0; k < events.size(); k++ )
+  {
+    const pressEvents &e = events[k];
+    int hold = t.presses[k].hold;
+
+    if( !e.released ) snprintf( error, sizeof(error), "press %u never released", (unsigned)k );
+    else if( e.singles > 1 || e.doubles > 1 || e.longs > 1 ) snprintf( error, sizeof(error), "press %u gave %d singles, %d doubles, %d long presses", (unsigned)k, e.singles, e.doubles, e.longs );
+    else if( e.singles && e.doubles ) snprintf( error, sizeof(error), "press %u gave a single and a double click", (unsigned)k );
+    else if( k > 0 && (int)( pushAt[k] - pushAt[k - 1] ) < DOUBLE_CLICK - TOLERANCE && !e.doubles ) snprintf( error, sizeof(error), "press %u missed double click", (unsigned)k );
+    else if( k > 0 && (int)( pushAt[k] - pushAt[k - 1] ) > DOUBLE_CLICK + TOLERANCE && e.doubles ) snprintf( error, sizeof(error), "press %u gave unexpected double click", (unsigned)k );
+    else if( !e.doubles && hold > DOUBLE_CLICK + TOLERANCE && !e.singles ) snprintf( error, sizeof(error), "press %u missed single click", (unsigned)k );
+    else if( hold < DOUBLE_CLICK - TOLERANCE && e.singles ) snprintf( error, sizeof(error), "press %u gave unexpected single click", (unsigned)k );
+    else if( hold > LONG_PRESS + TOLERANCE && !e.longs ) snprintf( error, sizeof(error), "press %u missed long press", (unsigned)k );
+    else if( hold < LONG_PRESS - TOLERANCE && e.longs ) snprintf( error, sizeof(error), "press %u gave unexpected long press", (unsigned)k );
+    else continue;
+
+    return error;
+  }
+
+  return "";
+}
+
+
+// Random timeline - short presses and gaps mixed in, so double clicks happen
+
+timeline generate( xorshift &rng )
+{
+  timeline t;
+
+  t.start = rng.range( 0, 1 ) ? 0UL - rng.range( 0, 8000 ) : rng.next();
+
+  int count = rng.range( 1, MAX_PRESSES );
+
+  for( int i = 0; i < count; i++ )
+  {
+    press p;
+    uint32_t kind = rng.range( 0, 9 );
+
+    p.hold = kind < 7 ? rng.range( MIN_STEADY, 400 ) : kind < 9 ? rng.range( 400, 900 ) : rng.range( 900, 1600 );
+    p.gap = rng.range( 0, 1 ) ? rng.range( MIN_STEADY, 160 ) : rng.range( 160, 800 );
+    p.seed = rng.next() | 1;
+
+    t.presses.push_back( p );
+  }
+
+  return t;
+}
+
+
+// Smallest timeline that still fails - drop presses, then clean up edges
+
+timeline shrink( timeline t, bool adaptive )
+{
+  bool smaller = true;
+
+  while( smaller )
+  {
+    smaller = false;
+
+    for( size_t i = 0; i < t.presses.size() && t.presses.size() > 1; i++ )
+    {
+      timeline attempt = t;
+      attempt.presses.erase( attempt.presses.begin() + i );
+
+      if( !check( attempt, adaptive ).empty() )
+      {
+        t = attempt;
+        smaller = true;
+        i--;
+      }
+    }
+
+    for( size_t i = 0; i < t.presses.size(); i++ )
+    {
+      if( t.presses[i].seed == 0 ) continue;
+
+      timeline attempt = t;
+      attempt.presses[i].seed = 0;
+
+      if( !check( attempt, adaptive ).empty() )
+      {
+        t = attempt;
+        smaller = true;
+      }
+    }
+  }
+
+  return t;
+}
+
+// Timelines per run - FUZZ_TIMELINES in the environment for a long run
+
+long timelineCount()
+{
+  const char *count = getenv( "FUZZ_TIMELINES" );
+
+  return count && atol( count ) > 0 ? atol( count ) : TIMELINES;
+}
+
+// Does a timeline run past millis() wrapping
+
+bool crossesWrap( const timeline &t )
+{
+  unsigned long length = LEAD_IN;
+
+  for( const press &p : t.presses ) length += p.hold + p.gap;
+
+  return t.start + length < t.start;
+}
+
+
+// Run a batch of random timelines
+
+void fuzz( bool adaptive, uint32_t seed )
+{
+  xorshift rng = { seed };
+  long timelines = timelineCount();
+  long wrapped = 0;
+
+  polls = 0;
+
+  auto began = std::chrono::steady_clock::now();
+
+  for( long n = 0; n < timelines; n++ )
+  {
+    timeline t = generate( rng );
+    std::string error = check( t, adaptive );
+
+    wrapped += crossesWrap( t );
+
+    if( !error.empty() )
+    {
+      timeline small = shrink( t, adaptive );
+
+      printf( "Seed %08x, timeline %ld: %s\n", (unsigned)seed, n, error.c_str() );
+      printf( "Smallest failing: %s\n", check( small, adaptive ).c_str() );
+      printTimeline( small );
+
+      TEST_FAIL_MESSAGE( "Switch failed a timeline - see above" );
+    }
+  }
+
+  double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - began ).count();
+
+  printf( "%s debounce: %ld timelines (%ld across millis() wrapping), %lu polls in %.2fs - %.0f timelines/s, %.1fM polls/s\n",
+    adaptive ? "Adaptive" : "Fixed", timelines, wrapped, polls, seconds, timelines / seconds, polls / seconds / 1e6 );
+
+  TEST_ASSERT_GREATER_THAN( timelines / 4, wrapped );
+}
+
+void test_fuzz_fixed_debounce()
+{
+  fuzz( false, 0x5EED0001 );
+}
+
+void test_fuzz_adaptive_debounce()
+{
+  fuzz( true, 0x5EED0002 );
+}
+
+
+// The first push after boot is not a double click against a push that never happened
+
+void test_first_push_not_double()
+{
+  hostMillis() = 0;
+  hostPins()[PIN] = LOW;
+
+  Switch button( PIN, INPUT, HIGH, DEBOUNCE, LONG_PRESS, DOUBLE_CLICK, DEGLITCH );
+  bool doubled = false;
+
+  for( unsigned long ms = 0; ms < 200; ms++ )
+  {
+    button.poll( ms >= 5, ms );
+    doubled |= button.doubleClick();
+  }
+
+  TEST_ASSERT_FALSE( doubled );
+}
+
+
+// Press and release with a clean push, and a glitch of glitchLength ms bounceAt ms after the release is seen.
+// Returns the switches seen
+
+int pressWithLateBounce( Switch &button, unsigned long &ms, unsigned bounceAt, unsigned glitchLength )
+{
+  int switches = 0;
+  unsigned long releaseSeen = 0;
+
+  for( int i = 0; i < 200; i++, ms++ )                    // Held
+  {
+    button.poll( HIGH, ms );
+    switches += button.switched();
+  }
+
+  for( int i = 0; i < 400; i++, ms++ )                    // Released, with bounce after release is seen
+  {
+    bool level = LOW;
+
+    if( releaseSeen && ms >= releaseSeen + bounceAt && ms < releaseSeen + bounceAt + glitchLength ) level = HIGH;
+
+    button.poll( level, ms );
+    switches += button.switched();
+
+    if( button.released() && !releaseSeen ) releaseSeen = ms;
+  }
+
+  return switches;
+}
+
+// Learned period restored from flash is kept after the next switch
+
+void test_adaptive_restored_period_kept()
+{
+  hostMillis() = 0;
+  hostPins()[PIN] = LOW;
+
+  Switch button( PIN, INPUT, HIGH, DEBOUNCE, LONG_PRESS, DOUBLE_CLICK, DEGLITCH );
+  button.setAdaptiveDebounce( ADAPTIVE_MIN );
+  button.setDebouncePeriod( 30 );
+
+  unsigned long ms = 0;
+  pressWithLateBounce( button, ms, 0, 0 );
+
+  printf( "Restored 30ms, after one clean press: %dms\n", button.getDebouncePeriod() );
+
+  TEST_ASSERT_GREATER_THAN( 25, button.getDebouncePeriod() );
+}
+
+// Window learned down on a clean switch grows back when the switch starts bouncing late
+
+void test_adaptive_window_grows_back()
+{
+  hostMillis() = 0;
+  hostPins()[PIN] = LOW;
+
+  Switch button( PIN, INPUT, HIGH, DEBOUNCE, LONG_PRESS, DOUBLE_CLICK, DEGLITCH );
+  button.setAdaptiveDebounce( ADAPTIVE_MIN );
+
+  unsigned long ms = 0;
+
+  for( int i = 0; i < 20; i++ ) pressWithLateBounce( button, ms, 0, 0 );
+
+  TEST_ASSERT_EQUAL( ADAPTIVE_MIN, button.getDebouncePeriod() );
+
+  int first = pressWithLateBounce( button, ms, 20, 12 );   // 12ms bounce, 20ms after the release
+  int later = 0;
+
+  for( int i = 0; i < 8; i++ ) later += pressWithLateBounce( button, ms, 20, 12 );
+
+  printf( "Late bounce: first press %d switches, next 8 presses %d switches, window %dms, peak bounce %dms\n",
+    first, later, button.getDebouncePeriod(), button.getBouncePeak() );
+
+  TEST_ASSERT_EQUAL( 8 * 2, later );
+  TEST_ASSERT_GREATER_THAN( 20, button.getBouncePeak() );
+}
+
+
+void setUp() {}
+void tearDown() {}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_first_push_not_double );
+  RUN_TEST( test_fuzz_fixed_debounce );
+  RUN_TEST( test_fuzz_adaptive_debounce );
+  RUN_TEST( test_adaptive_restored_period_kept );
+  RUN_TEST( test_adaptive_window_grows_back );
+  return UNITY_END();
+}